@@ -0,0 +1,233 @@
+//
+//  ecs_bench.c
+//  Microbenchmarks of the public API hot paths.
+//
+//  Usage: ecs_bench [threads]
+//  Every case runs on a freshly initialized ECS with a fixed entity and component layout,
+//  so results only depend on the machine and the thread count.
+//
+
+#include "../ecs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_FRAMES 10		//! frames ecsRunSystems is timed over
+
+static const size_t benchEntityCounts[] = { 1000, 100000, 1000000 };
+static const size_t benchTypeCounts[] = { 1, 8, 64 };
+
+#ifdef ECS_BENCH_COUNT_ALLOCS
+// linked with --wrap, so every allocation made by the bench and the library passes through here
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static size_t benchAllocs = 0;
+
+void* __wrap_malloc(size_t size)				{ benchAllocs++; return __real_malloc(size); }
+void* __wrap_calloc(size_t count, size_t size)	{ benchAllocs++; return __real_calloc(count, size); }
+void* __wrap_realloc(void* ptr, size_t size)	{ benchAllocs++; return __real_realloc(ptr, size); }
+#endif
+
+typedef struct BenchTimer {
+	struct timespec	start;
+	size_t			allocs;
+} BenchTimer;
+
+typedef struct BenchWorld {
+	size_t				entityCount;
+	size_t				typeCount;
+	ecsComponentMask	types[64];
+	ecsComponentMask	extra;		//! attached by the attach case, not part of any initial layout
+	ecsEntityId*		ids;
+} BenchWorld;
+
+static int benchThreads = 1;
+static volatile size_t benchSink;	//! keeps results alive so reads are not optimized out
+
+static void benchStart(BenchTimer* timer)
+{
+#ifdef ECS_BENCH_COUNT_ALLOCS
+	timer->allocs = benchAllocs;
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+static void benchReport(BenchTimer* timer, const char* name, const BenchWorld* world, size_t ops)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double ns = (double)(end.tv_sec - timer->start.tv_sec) * 1e9 + (double)(end.tv_nsec - timer->start.tv_nsec);
+
+	printf("%-14s %10zu %6zu %12.2f", name, world->entityCount, world->typeCount, ops > 0 ? ns / (double)ops : 0.0);
+#ifdef ECS_BENCH_COUNT_ALLOCS
+	printf(" %10zu\n", benchAllocs - timer->allocs);
+#else
+	printf(" %10s\n", "n/a");
+#endif
+}
+
+/**
+ * \brief The components entity i starts with, spreading entities over up to typeCount * (typeCount + 1) / 2 archetypes.
+ */
+static ecsComponentMask benchLayout(const BenchWorld* world, size_t i)
+{
+	return ecsMaskOr(world->types[i % world->typeCount], world->types[(i / world->typeCount) % world->typeCount]);
+}
+
+static int benchInit(BenchWorld* world, size_t entityCount, size_t typeCount)
+{
+	ecsInitEx(&(ecsConfig){ .threadCount = benchThreads });
+	world->entityCount = entityCount;
+	world->typeCount = typeCount;
+	for(size_t i = 0; i < typeCount; i++)
+		world->types[i] = ecsRegisterComponent(int);
+	world->extra = ecsRegisterComponent(int);
+
+	world->ids = malloc(entityCount * sizeof(ecsEntityId));
+	if(world->ids == NULL)
+	{
+		ecsTerminate();
+		return 0;
+	}
+	return 1;
+}
+
+static void benchTerminate(BenchWorld* world)
+{
+	free(world->ids);
+	ecsTerminate();
+}
+
+static void benchCreateEntities(BenchWorld* world)
+{
+	for(size_t i = 0; i < world->entityCount; i++)
+		world->ids[i] = ecsCreateEntity(benchLayout(world, i));
+}
+
+static void benchCountSystem(ecsEntityId* entities, void** columns, const size_t* strides, size_t count, float deltaTime)
+{
+	int* values = columns[0];
+	for(size_t i = 0; i < count; i++)
+		values[i]++;
+}
+
+static void benchCreate(size_t entityCount, size_t typeCount)
+{
+	BenchWorld world;
+	BenchTimer timer;
+	if(!benchInit(&world, entityCount, typeCount)) return;
+
+	benchStart(&timer);
+	benchCreateEntities(&world);
+	benchReport(&timer, "create", &world, entityCount);
+
+	benchTerminate(&world);
+}
+
+static void benchAttach(size_t entityCount, size_t typeCount)
+{
+	BenchWorld world;
+	BenchTimer timer;
+	if(!benchInit(&world, entityCount, typeCount)) return;
+	benchCreateEntities(&world);
+
+	benchStart(&timer);
+	for(size_t i = 0; i < entityCount; i++)
+		ecsAttachComponents(world.ids[i], world.extra);
+	benchReport(&timer, "attach", &world, entityCount);
+
+	benchTerminate(&world);
+}
+
+static void benchGet(size_t entityCount, size_t typeCount)
+{
+	BenchWorld world;
+	BenchTimer timer;
+	if(!benchInit(&world, entityCount, typeCount)) return;
+	benchCreateEntities(&world);
+
+	// visit entities in a scattered order so the lookup is not just streaming through memory
+	size_t sum = 0;
+	size_t stride = 7919; // prime, coprime with every entity count used
+	benchStart(&timer);
+	for(size_t i = 0, j = 0; i < entityCount; i++, j = (j + stride) % entityCount)
+		sum += *(int*)ecsGetComponentPtr(world.ids[j], world.types[j % typeCount]);
+	benchReport(&timer, "get", &world, entityCount);
+	benchSink = sum;
+
+	benchTerminate(&world);
+}
+
+static void benchDestroy(size_t entityCount, size_t typeCount)
+{
+	BenchWorld world;
+	BenchTimer timer;
+	if(!benchInit(&world, entityCount, typeCount)) return;
+	benchCreateEntities(&world);
+
+	benchStart(&timer);
+	for(size_t i = 0; i < entityCount; i++)
+		ecsDestroyEntity(world.ids[i]);
+	ecsRunTasks();
+	benchReport(&timer, "destroy+tasks", &world, entityCount);
+
+	benchTerminate(&world);
+}
+
+static void benchRunSystems(size_t entityCount, size_t typeCount)
+{
+	BenchWorld world;
+	BenchTimer timer;
+	if(!benchInit(&world, entityCount, typeCount)) return;
+	benchCreateEntities(&world);
+
+	ecsEnableSystemEx(&(ecsSystemDesc){
+		.columnFn = benchCountSystem,
+		.components = world.types[0],
+		.comparison = ECS_QUERY_ALL,
+		.maxThreads = benchThreads,
+		.writeComponents = world.types[0],
+		.columns = { world.types[0] }
+	});
+	ecsRunSystems(0.0f); // warm up the query cache and system graph
+
+	// count matching entities once, ns/op is per entity per frame
+	size_t matched = 0;
+	for(size_t i = 0; i < entityCount; i++)
+		matched += ecsMaskIntersects(benchLayout(&world, i), world.types[0]);
+
+	benchStart(&timer);
+	for(size_t i = 0; i < BENCH_FRAMES; i++)
+		ecsRunSystems(1.0f / 60.0f);
+	benchReport(&timer, "run systems", &world, matched * BENCH_FRAMES);
+
+	benchTerminate(&world);
+}
+
+int main(int argc, char** argv)
+{
+	if(argc > 1)
+		benchThreads = atoi(argv[1]) > 0 ? atoi(argv[1]) : 1;
+
+	void (*cases[])(size_t, size_t) = { benchCreate, benchAttach, benchGet, benchDestroy, benchRunSystems };
+
+	printf("threads: %d\n", benchThreads);
+	printf("%-14s %10s %6s %12s %10s\n", "case", "entities", "types", "ns/op", "allocs");
+	for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		for(size_t e = 0; e < sizeof(benchEntityCounts) / sizeof(benchEntityCounts[0]); e++)
+		{
+			for(size_t t = 0; t < sizeof(benchTypeCounts) / sizeof(benchTypeCounts[0]); t++)
+			{
+				// the extra component used by the attach case needs a free bit
+				if(benchTypeCounts[t] >= ECS_COMPONENT_BITS)
+					cases[c](benchEntityCounts[e], ECS_COMPONENT_BITS - 1);
+				else
+					cases[c](benchEntityCounts[e], benchTypeCounts[t]);
+			}
+		}
+	}
+	return 0;
+}
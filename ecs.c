@@ -9,16 +9,58 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
-#include <math.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 typedef unsigned char BYTE;
 
+#define ECS_CHUNK_SIZE		(16 * 1024)			//! preferred size of a block of archetype storage
+#define ECS_COLUMN_ALIGN	16					//! alignment of each component column in a chunk
+#define ECS_MAX_COMPONENTS	ECS_COMPONENT_BITS
+#define ECS_NO_SLOT			((size_t)-1)
+#define ECS_RESERVED_SLOT	((size_t)-2)		//! row of a slot handed out by ecsCreateEntitiesDeferred that has not been created yet
+#define ECS_MIN_CAPACITY	8					//! smallest non-zero capacity of any list
+#define ECS_RANGES_PER_THREAD	8				//! ranges per thread a multithreaded system is split into by default
+#define ECS_IDLE_SPINS		64					//! failed looks for work after which a thread waits for more to be pushed
+#define ECS_ARENA_ALIGN		16					//! alignment of every allocation from the frame arena
+#define ECS_ARENA_MIN_CAPACITY	(64 * 1024)		//! smallest block the frame arena allocates
+#define ECS_POOL_SLAB_CHUNKS	16				//! chunks the chunk pool allocates at once
+#define ECS_SPARSE_TAG_RATIO	16				//! matching rows per tagged entity from which tag queries visit tagged entities instead of every row
+#define ECS_PARALLEL_MATCH_ROWS	16384			//! rows from which a query filtering rows matches them on all threads
+#define ECS_MAX_CHUNK_ROWS	(ECS_CHUNK_SIZE / (sizeof(ecsEntityId) + sizeof(ecsComponentMask)))	//! most rows a chunk can hold
+
+#define ecsMakeEntityId(__index, __version) ((ecsEntityId)(__index) | ((ecsEntityId)(__version) << ECS_ENTITY_INDEX_BITS))
+
+// the 64 bit words of a mask, given a pointer to it
+#if ECS_COMPONENT_BITS == 64
+#define ecsMaskWords(__mask) (__mask)
+#else
+#define ecsMaskWords(__mask) ((__mask)->words)
+#endif
+
 typedef struct ECSsystem {
 	ecsSystemFn			fn;
-	ecsComponentQuery	query;
+	ecsColumnSystemFn	columnFn;	//! called instead of fn when set
+	const char*			name;		//! shown in profiles, owned by the caller
+	size_t				columnCount;
+	size_t*				columnTypes;	//! component type index of each column, ECS_NO_SLOT if unregistered
+	size_t*				strides;		//! size of each column's component, shares an allocation with columnTypes
+	ecsQueryDesc		query;
+	int					hasQuery;	//! 0 for ECS_NOQUERY systems, which run once per frame without entities
 	int					maxThreads;
 	int					execOrder;
+	size_t				grainSize;	//! smallest number of entities worth handing to another thread, 0 to pick automatically
+	ecsComponentMask	readMask;	//! components the system reads, nocomponent with writeMask if undeclared
+	ecsComponentMask	writeMask;	//! components the system writes
+	ecsComponentMask	changedMask;	//! only chunks where one of these changed since the last run are gathered, if not empty
+	struct ECSsystemState* state;	//! allocated when the system is enabled
 } ECSsystem;
 
 /**
@@ -31,622 +73,3679 @@ typedef struct ecsTask {
 		ECS_COMPONENTS_DETACH,		//! Uses .entity and .components.mask
 		ECS_SYSTEM_CREATE,			//! Uses .system and .components
 		ECS_SYSTEM_DESTROY,			//! Uses .system
+		ECS_ENTITIES_CREATE,		//! Uses .entity, .count and .components.mask
 	} type;
 	
 	ecsEntityId			entity;		//! relevant entity id
 	ECSsystem			system;		//! relevant system function pointer
 	ecsComponentQuery	components;	//! relevant components
+	size_t				count;		//! number of consecutive entities starting at .entity
 } ecsTask;
 
+typedef struct ECScolumn {
+	size_t		type;		//! index of the component type in ecsComponents
+	size_t		offset;		//! byte offset of the column from the start of a chunk
+	size_t		size;		//! size of a single component
+} ECScolumn;
+
+/**
+ * \brief Fixed size block of memory holding a number of rows of an archetype.
+ * \note Data is laid out as an array of entity ids, an array of entity masks and one array per component column,
+ * followed by the change tick of each column.
+ */
+typedef struct ECSchunk {
+	size_t		count;
+	BYTE*		data;
+} ECSchunk;
+
+/**
+ * \brief Storage for all entities sharing the exact same component mask.
+ * \note Every chunk except the last one in use is full, so row r lives in chunk r / chunkCapacity.
+ */
+typedef struct ECSarchetype {
+	ecsComponentMask	mask;			//! components of every row, without tags
+	size_t				count;			//! number of rows over all chunks
+	size_t				chunkCapacity;	//! number of rows per chunk
+	size_t				chunkBytes;		//! allocation size of a single chunk
+	size_t				ticksOffset;	//! byte offset of the column change ticks from the start of a chunk
+	size_t				columnCount;
+	ECScolumn*			columns;
+	int					columnOf[ECS_MAX_COMPONENTS]; //! column index for each component type, -1 if not present
+	size_t				chunkCount;
+	size_t				chunksCapacity;
+	ECSchunk*			chunks;
+} ECSarchetype;
+
+/**
+ * \brief Slot in the sparse entity index, addressed by ecsEntityIndex of an id.
+ * \note A free slot has archetype set to NULL, id holding the version its next occupant will get
+ * and row holding the index of the next free slot.
+ */
 typedef struct ECSentityData {
 	ecsEntityId		id;
 	ecsComponentMask	mask;
+	ECSarchetype*	archetype;
+	size_t			row;
 } ECSentityData;
 
+/**
+ * \brief Two level bitset of entity slots, the second level marks non-zero words of the first
+ * so that scans skip 4096 slots at a time where the set is empty.
+ */
+typedef struct ECSslotSet {
+	uint64_t*	words;			//! bit b of word w is slot w * 64 + b
+	uint64_t*	summary;		//! bit b of word s is set if words[s * 64 + b] is not zero
+	size_t		wordCapacity;	//! a multiple of 64, so summary words are always whole
+	size_t		count;			//! number of slots in the set
+	int			incomplete;		//! set once a slot could not be added, the set can not be used for queries from then on
+} ECSslotSet;
+
 typedef struct ECScomponentType {
 	ecsComponentMask		id;
-	size_t			stride;
 	size_t			componentSize;
-	size_t			size;
-	void*			begin;
+	size_t			alignment;		//! of the start of its columns, at least ECS_COLUMN_ALIGN
+	ECSslotSet		slots;			//! entities carrying the component, only kept for tags
 } ECScomponentType;
 
 typedef struct ECScomponentList {
 	size_t				size;
+	size_t				capacity;
 	ECScomponentType*	begin;
+	ecsComponentMask	registered;	//! all component types made so far
+	ecsComponentMask	tags;		//! component types without data, only kept in entity masks
 } ECScomponentList;
 
+typedef struct ECSarchetypeList {
+	size_t			size;
+	size_t			capacity;
+	ECSarchetype**	begin;
+	size_t			mapCapacity;	//! number of slots in map, always a power of two
+	ECSarchetype**	map;			//! open addressing table of archetypes keyed by mask
+} ECSarchetypeList;
+
 typedef struct ECSentityList {
 	size_t		size;
-	size_t		nextValidId;
+	size_t		capacity;
+	size_t		freeList;	//! index of the first free slot, ECS_NO_SLOT if none
+	atomic_size_t reserved;	//! number of slots past size handed out by ecsCreateEntitiesDeferred
+	size_t		unclaimed;	//! first slot that may still be reserved but never created, ECS_NO_SLOT if none
 	ECSentityData* begin;
 } ECSentityList;
 
 typedef struct ECSsystemList {
 	size_t		size;
+	size_t		capacity;
 	ECSsystem*	begin;
 } ECSsystemList;
 
 typedef struct ECStaskQueue {
 	size_t size;
+	size_t capacity;
 	ecsTask* begin;
 } ECStaskQueue;
 
+/**
+ * \brief A run of entities stored contiguously in a single chunk.
+ */
+typedef struct ECSchunkView {
+	ecsEntityId*		entities;	//! start of the chunk
+	ecsComponentMask*	components;	//! masks of the chunk
+	atomic_size_t*		ticks;		//! change ticks of the chunk
+	size_t				first;		//! row in the chunk the view starts at
+	size_t				count;
+	struct ECSarchetype* archetype;	//! locates component columns relative to entities
+} ECSchunkView;
+
+typedef struct ECSviewList {
+	size_t			size;
+	size_t			capacity;
+	ECSchunkView*	begin;
+} ECSviewList;
+
+typedef struct ecsRunSystemArgs {
+	ecsSystemFn fn;
+	const ECSsystem* system;
+	ECSchunkView* views;
+	size_t begin;
+	size_t count;
+	float deltaTime;
+} ecsRunSystemArgs;
+
+/**
+ * \brief A block of the frame arena, the memory handed out follows the header.
+ */
+typedef struct ECSarenaBlock {
+	struct ECSarenaBlock*	previous;
+	size_t					base;		//! bytes in use in earlier blocks when this one was added
+	size_t					capacity;
+	size_t					used;
+} ECSarenaBlock;
+
+/**
+ * \brief Linear allocator for temporaries of the thread calling ecsRunTasks, released in reverse order with ecsArenaRelease.
+ * \note Blocks added to make room are freed on release, and the first block grows to the peak usage between frames,
+ * so a steady state frame allocates nothing.
+ */
+typedef struct ECSarena {
+	ECSarenaBlock*	top;
+	size_t			used;		//! bytes handed out over all blocks
+	size_t			peak;		//! most bytes in use at once since the last ecsArenaTrim
+} ECSarena;
+
+/**
+ * \brief Recycles chunks of ECS_CHUNK_SIZE bytes, which are allocated in slabs of ECS_POOL_SLAB_CHUNKS.
+ */
+typedef struct ECSchunkPool {
+	void*		freeList;		//! released chunks, each starting with a pointer to the next
+	size_t		freeCount;
+	BYTE**		slabs;
+	size_t		slabCount;
+	size_t		slabCapacity;
+} ECSchunkPool;
+
+/**
+ * \brief Components to detach from one entity, combined over every queued detach task.
+ */
+typedef struct ECSpendingDetach {
+	size_t				index;		//! slot of the entity
+	ecsComponentMask	mask;
+} ECSpendingDetach;
+
+typedef struct ECSdetachBatch {
+	size_t				size;
+	size_t				capacity;
+	ECSpendingDetach*	begin;
+	size_t				slotCapacity;
+	size_t*				slots;		//! position in begin of the pending detach of each entity slot, stale unless it points back
+} ECSdetachBatch;
+
+/**
+ * \brief A system running over a number of entities, split into ranges spread over the worker pool.
+ */
+typedef struct ECSjob {
+	ecsRunSystemArgs	args;		//! system, views and delta time shared by all ranges
+	size_t				grain;		//! ranges are split until they are no larger than this
+	size_t				system;		//! index of the system in ecsSystems
+	atomic_size_t		remaining;	//! number of entities not yet processed
+	int					matching;	//! ranges are candidate chunks to match rows of, see ecsMatchRange
+	size_t				threadLimit;//! most threads running ranges of the job at once, 0 for no limit
+	atomic_size_t		active;		//! threads currently running a range of the job, see ecsEnterJob
+} ECSjob;
+
+/**
+ * \brief Frame to frame state of an enabled system.
+ */
+typedef struct ECSsystemState {
+	ECSviewList		views;				//! chunks matching the query, gathered when the system starts
+	size_t			matchCount;
+	size_t			matchCapacity;
+	ECSarchetype**	matches;			//! archetypes matching the query
+	size_t			archetypesSeen;		//! number of archetypes already tested against the query
+	size_t			changeTick;			//! tick of the latest run, stamped on components the system changes
+	unsigned long long	startTime;		//! timings of the current frame when profiling, see ecsSystemProfile
+	unsigned long long	gatherTime;
+	unsigned long long	finishTime;
+	size_t			entityCount;
+	atomic_ullong	rangeTime;
+	atomic_size_t	rangeCount;
+	ECSjob			job;
+	ECSviewList		candidates;			//! whole chunks whose rows are matched on all threads before job runs
+	size_t			rowWordCapacity;
+	uint64_t*		rowBits;			//! matching rows of the candidates, each candidate starting at a new word
+	size_t			candidateCapacity;
+	size_t*			candidateWords;		//! word in rowBits each candidate starts at
+	ECSjob			matchJob;			//! splits the candidates between threads
+	atomic_size_t	pending;			//! number of systems that have to finish before this one starts
+	size_t			dependencyCount;
+	size_t			dependentCount;
+	size_t			dependentCapacity;
+	size_t*			dependents;			//! indices of systems waiting for this one to finish
+} ECSsystemState;
+
+/**
+ * \brief A range of entities of a job, [begin, end).
+ * \note A begin of ECS_NO_SLOT requests starting the system of job instead.
+ */
+typedef struct ECSrange {
+	ECSjob*		job;
+	size_t		begin;
+	size_t		end;
+} ECSrange;
+
+/**
+ * \brief Ranges waiting to be run by a worker, other workers steal from the opposite end when idle.
+ */
+typedef struct ECSdeque {
+	pthread_mutex_t	lock;
+	size_t			head;		//! index of the oldest range
+	size_t			tail;		//! one past the newest range
+	size_t			capacity;
+	ECSrange*		begin;
+} ECSdeque;
+
+/**
+ * \brief Consecutive tasks pushed by one system while running one range of entities.
+ */
+typedef struct ECScommandSegment {
+	size_t		system;		//! index of the system in ecsSystems
+	size_t		begin;		//! first entity of the range
+	size_t		owner;		//! participant whose command buffer holds the tasks
+	size_t		first;		//! index of the first task in that buffer
+	size_t		count;
+} ECScommandSegment;
+
+/**
+ * \brief Tasks pushed by systems running on one participant of the worker pool.
+ * \note Only the owning thread touches a buffer while systems run, ecsRunTasks merges all of them afterwards.
+ */
+typedef struct ECScommandBuffer {
+	ECStaskQueue		tasks;
+	size_t				segmentCount;
+	size_t				segmentCapacity;
+	ECScommandSegment*	segments;
+} ECScommandBuffer;
+
+/**
+ * \brief What a worker thread needs to know before it can look at its pool.
+ */
+typedef struct ECSworkerStart {
+	struct ecsWorld*	world;
+	size_t				self;
+} ECSworkerStart;
+
+/**
+ * \brief Threads kept alive between frames to run systems.
+ * \note The thread calling ecsRunSystems works on systems as well, so size is one less than the configured thread count.
+ */
+typedef struct ECSworkerPool {
+	size_t				size;
+	pthread_t*			threads;
+	ECSworkerStart*		starts;		//! arguments of each thread, indexed like threads
+	ECSdeque*			deques;		//! one per worker, index 0 belongs to the thread calling ecsRunSystems
+	ECScommandBuffer*	commands;	//! one per worker, indexed like deques
+	pthread_mutex_t		lock;
+	pthread_cond_t		wake;		//! signalled when a job is published or the pool shuts down
+	ECSdeque			mainQueue;	//! start requests of systems that only run on the thread calling ecsRunSystems
+	pthread_cond_t		done;		//! signalled when the last busy worker goes idle
+	size_t				generation;	//! incremented for every frame
+	size_t				busy;		//! number of workers currently working on a frame
+	int					quit;
+	atomic_size_t		remaining;	//! number of systems that have not finished this frame
+	float				deltaTime;
+	int					parallel;	//! whether frames have work for more than one thread, see ecsBuildSystemGraph
+	pthread_mutex_t		idleLock;
+	pthread_cond_t		idle;		//! signalled when work is pushed or the frame ends while threads wait for either
+	atomic_size_t		posted;		//! incremented whenever work is pushed or the frame ends
+	atomic_size_t		sleeping;	//! number of threads waiting on idle
+} ECSworkerPool;
+
 // forward declare helper functions
+static inline void* ecsMalloc(size_t size);
+static inline void* ecsCalloc(size_t count, size_t size);
+static inline void* ecsRealloc(void* ptr, size_t size);
+static inline void ecsFree(void* ptr);
+static void* ecsArenaPush(size_t size);
+static void ecsArenaRelease(size_t mark);
+static void ecsArenaTrim(void);
+static void ecsArenaFree(void);
+static void* ecsAllocChunk(size_t size);
+static void ecsFreeChunk(void* chunk, size_t size);
+static void ecsTrimChunkPool(void);
+static void ecsFreeChunkPool(void);
+static inline void* ecsReserve(void* begin, size_t* capacity, size_t count, size_t elementSize);
+static inline void* ecsShrink(void* begin, size_t* capacity, size_t count, size_t elementSize);
 static inline int ecsResizeComponents(size_t size);
-static inline int ecsResizeComponentType(ECScomponentType* type, size_t size);
+static inline int ecsResizeArchetypes(size_t size);
+static inline int ecsResizeArchetypeMap(size_t size);
+static inline int ecsResizeDetachSlots(size_t size);
+static inline int ecsResizeChunks(ECSarchetype* archetype, size_t size);
 static inline int ecsResizeEntities(size_t size);
 static inline int ecsResizeSystems(size_t size);
 static inline int ecsPushTaskStack(void);
 static inline void ecsClearTasks(void);
+static inline int ecsResizeViews(ECSviewList* views, size_t size);
+static int ecsStartWorkers(size_t count);
+static void ecsStopWorkers(void);
+static void ecsStartSystem(size_t self, size_t index);
+static void ecsMatchRange(size_t self, ECSrange range);
+static void ecsLaunchSystem(size_t self, size_t index, size_t total);
+static void ecsFinishSystem(size_t self, size_t index);
+static void ecsFreeSystem(ECSsystem* system);
+void ecsSortSystems(void);
+void* ecsRunSystem(void* args);
+static inline void ecsTrimArchetypes(void);
 static inline ECSentityData* ecsFindEntityData(ecsEntityId id);
 static inline ECScomponentType* ecsFindComponentType(ecsComponentMask id);
-static inline ECSsystem* ecsFindSystem(ecsSystemFn fn);
-static inline void* ecsFindComponentFor(ECScomponentType* type, ecsEntityId id);
+static inline ECSsystem* ecsFindSystem(ecsSystemFn fn, ecsColumnSystemFn columnFn);
+static inline ECSarchetype* ecsFindArchetype(ecsComponentMask mask);
+static ecsEntityId* ecsRadixSortEntities(ecsEntityId* keys, ecsEntityId* swap, size_t count);
 void ecsPushTask(ecsTask task);
+static void ecsPushCommand(ECScommandBuffer* commands, ecsTask task);
+static int ecsStartProfiler(size_t frameCount);
+static void ecsStopProfiler(void);
+static inline int ecsTiming(void);
+static inline unsigned long long ecsNow(void);
+static inline void ecsTimeRange(size_t self, size_t index, unsigned long long start, size_t count);
+static inline void ecsTrace(size_t self, const char* name, size_t track, unsigned long long start, unsigned long long duration, size_t count);
+static void ecsBeginProfiledFrame(void);
+static void ecsEndProfiledFrame(void);
+
+
+/**
+ * \brief Ring buffer holding the timings of the last frames, see ecsConfig.profileFrames.
+ */
+typedef struct ECSprofiler {
+	size_t				capacity;		//! number of frames kept, 0 while profiling is off
+	size_t				frameCount;		//! number of frames recorded so far
+	ecsFrameProfile*	frames;
+	size_t*				systemCapacities;	//! number of system profiles allocated for each frame
+	ecsThreadProfile*	threads;		//! ranges run by each thread during the current frame
+	unsigned long long	frameStart;
+	unsigned long long	taskTime;		//! time spent in ecsRunTasks since the last recorded frame
+	size_t				taskCount;
+} ECSprofiler;
+
+#define ECS_TRACE_INSTANT		((unsigned long long)-1)	//! duration of trace events without one
+#define ECS_TRACE_SYSTEM_TRACK	1000						//! track of the first system in traces, tracks below are threads
+
+typedef struct ECStraceEvent {
+	const char*			name;		//! NULL for systems without a name
+	unsigned long long	start;
+	unsigned long long	duration;	//! ECS_TRACE_INSTANT for events without duration
+	size_t				track;		//! thread index or ECS_TRACE_SYSTEM_TRACK plus system index
+	size_t				count;		//! number of entities, tasks or chunks involved
+} ECStraceEvent;
+
+/**
+ * \brief Events recorded by a single thread, only that thread writes to it while tracing.
+ */
+typedef struct ECStraceBuffer {
+	size_t			size;
+	size_t			dropped;		//! events lost because the buffer was full
+	ECStraceEvent*	events;
+} ECStraceBuffer;
 
+typedef struct ECStracer {
+	size_t				capacity;		//! events per thread, 0 while not tracing
+	size_t				bufferCount;
+	ECStraceBuffer*		buffers;		//! one per thread, indexed like ecsWorkers.deques
+	unsigned long long	origin;			//! time tracing started
+} ECStracer;
 
-ECSentityList		ecsEntities;
-ECScomponentList	ecsComponents;
-ECSsystemList		ecsSystems;
-ECStaskQueue		ecsTasks;
-int					ecsIsInit = 0;
+/**
+ * \brief Everything a single instance of the ECS owns.
+ */
+struct ecsWorld {
+	ECSentityList		entities;
+	ECScomponentList	components;
+	ECSarchetypeList	archetypes;
+	ECSsystemList		systems;
+	ECStaskQueue		tasks;
+	ECSworkerPool		workers;
+	ECSarena			arena;
+	ECSchunkPool		chunkPool;
+	ECSdetachBatch		detachBatch;
+	ECSprofiler			profiler;
+	ECStracer			tracer;
+	int					systemGraphDirty;
+	int					isInit;
+	atomic_size_t		changeTick;		//! tick of the latest system run
+	ecsAllocator		allocator;		//! every allocation of the world goes through it
+};
+
+static ecsWorld ecsDefaultWorld;
+
+// the world the calling thread acts on, workers act on the world they belong to
+static _Thread_local ecsWorld* ecsCurrentWorld = &ecsDefaultWorld;
+
+#define ecsEntities			(ecsCurrentWorld->entities)
+#define ecsComponents		(ecsCurrentWorld->components)
+#define ecsArchetypes		(ecsCurrentWorld->archetypes)
+#define ecsSystems			(ecsCurrentWorld->systems)
+#define ecsTasks			(ecsCurrentWorld->tasks)
+#define ecsWorkers			(ecsCurrentWorld->workers)
+#define ecsArena			(ecsCurrentWorld->arena)
+#define ecsChunkPool		(ecsCurrentWorld->chunkPool)
+#define ecsDetachBatch		(ecsCurrentWorld->detachBatch)
+#define ecsProfiler			(ecsCurrentWorld->profiler)
+#define ecsTracer			(ecsCurrentWorld->tracer)
+#define ecsSystemGraphDirty	(ecsCurrentWorld->systemGraphDirty)
+#define ecsIsInit			(ecsCurrentWorld->isInit)
+#define ecsChangeTick		(ecsCurrentWorld->changeTick)
+
+// set while a system runs, tasks it pushes go to this buffer under a key that does not depend on thread scheduling
+static _Thread_local ECScommandBuffer*	ecsThreadCommands = NULL;
+static _Thread_local size_t				ecsThreadSystem;
+static _Thread_local size_t				ecsThreadBegin;
+static _Thread_local size_t				ecsThreadIndex;
+
+static void* ecsDefaultAllocate(void* user, size_t size)				{ return malloc(size); }
+static void* ecsDefaultReallocate(void* user, void* ptr, size_t size)	{ return realloc(ptr, size); }
+static void ecsDefaultRelease(void* user, void* ptr)					{ free(ptr); }
+
+static const ecsAllocator ecsDefaultAllocator = {
+	.allocate	= ecsDefaultAllocate,
+	.reallocate	= ecsDefaultReallocate,
+	.release	= ecsDefaultRelease,
+	.user		= NULL
+};
 
 
 void ecsInit()
+{
+	ecsInitEx(NULL);
+}
+
+int ecsInitEx(const ecsConfig* config)
 {
 	assert(!ecsIsInit);
 
-	ecsEntities.nextValidId = 1;
+	ecsCurrentWorld->allocator = config != NULL && config->allocator != NULL ? *config->allocator : ecsDefaultAllocator;
+	ecsEntities.freeList	= ECS_NO_SLOT;
+	ecsEntities.unclaimed	= ECS_NO_SLOT;
+	atomic_init(&ecsEntities.reserved, 0);
+	atomic_init(&ecsChangeTick, 0);
 	ecsEntities.begin		= NULL;
 	ecsComponents.begin		= NULL;
+	ecsArchetypes.begin		= NULL;
+	ecsArchetypes.map		= NULL;
+	memset(&ecsArena, 0x0, sizeof(ecsArena));
+	memset(&ecsChunkPool, 0x0, sizeof(ecsChunkPool));
+	ecsDetachBatch.begin	= NULL;
+	ecsDetachBatch.slots	= NULL;
 	ecsSystems.begin		= NULL;
 	ecsTasks.begin			= NULL;
-	ecsEntities.size = ecsComponents.size = ecsSystems.size = ecsTasks.size = 0;
+	ecsEntities.size = ecsComponents.size = ecsArchetypes.size = ecsSystems.size = ecsTasks.size = 0;
+	ecsEntities.capacity = ecsComponents.capacity = ecsArchetypes.capacity = ecsSystems.capacity = ecsTasks.capacity = 0;
+	ecsArchetypes.mapCapacity = 0;
+	ecsDetachBatch.size = ecsDetachBatch.capacity = ecsDetachBatch.slotCapacity = 0;
+	ecsComponents.registered = ecsComponents.tags = nocomponent;
+	ecsSystemGraphDirty = 0;
+	
+	// one thread per hardware thread unless configured otherwise
+	long threadCount = config != NULL ? config->threadCount : 0;
+	if(threadCount <= 0)
+		threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threadCount <= 0)
+		threadCount = 1;
+	
+	// the calling thread makes up for the last thread, and for all of them if they cannot be started
+	if(!ecsStartWorkers((size_t)threadCount - 1))
+	{
+		ecsStopWorkers();
+		if(!ecsStartWorkers(0))
+		{
+			ecsStopWorkers();
+			return 0;
+		}
+	}
+	
+	memset(&ecsProfiler, 0x0, sizeof(ecsProfiler));
+	memset(&ecsTracer, 0x0, sizeof(ecsTracer));
+	if(config != NULL && config->profileFrames > 0)
+		ecsStartProfiler(config->profileFrames);
 
 	ecsIsInit = 1;
+	return 1;
 }
 
 void ecsTerminate()
 {
 	assert(ecsIsInit);
+	
+	ecsStopWorkers();
+	ecsStopProfiler();
+	ecsStopTrace();
 
-	if(ecsEntities.begin)	free(ecsEntities.begin);
-	if(ecsSystems.begin)	free(ecsSystems.begin);
-	if(ecsTasks.begin)		free(ecsTasks.begin);
+	for(size_t i = 0; i < ecsSystems.size; i++)
+		ecsFreeSystem(ecsSystems.begin + i);
+	for(size_t i = 0; i < ecsTasks.size; i++)
+	{
+		if(ecsTasks.begin[i].type == ECS_SYSTEM_CREATE)
+			ecsFreeSystem(&ecsTasks.begin[i].system);
+	}
+	
+	if(ecsEntities.begin)	ecsFree(ecsEntities.begin);
+	if(ecsSystems.begin)	ecsFree(ecsSystems.begin);
+	if(ecsTasks.begin)		ecsFree(ecsTasks.begin);
+	for(size_t i = 0; i < ecsComponents.size; i++)
+	{
+		ecsFree(ecsComponents.begin[i].slots.words);
+		ecsFree(ecsComponents.begin[i].slots.summary);
+	}
+	if(ecsComponents.begin)	ecsFree(ecsComponents.begin);
 	
-	if(ecsComponents.begin)
+	if(ecsArchetypes.begin)
 	{
-		ECScomponentType* type;
-		for(size_t i = 0; i < ecsComponents.size; i++)
+		ECSarchetype* archetype;
+		for(size_t i = 0; i < ecsArchetypes.size; i++)
 		{
-			type = ecsComponents.begin + i;
-			if(type->begin)
-				free(type->begin);
+			archetype = ecsArchetypes.begin[i];
+			ecsResizeChunks(archetype, 0);
+			if(archetype->chunks)	ecsFree(archetype->chunks);
+			if(archetype->columns)	ecsFree(archetype->columns);
+			ecsFree(archetype);
 		}
-		free(ecsComponents.begin);
+		ecsFree(ecsArchetypes.begin);
 	}
+	if(ecsArchetypes.map)	ecsFree(ecsArchetypes.map);
+	if(ecsDetachBatch.begin)	ecsFree(ecsDetachBatch.begin);
+	if(ecsDetachBatch.slots)	ecsFree(ecsDetachBatch.slots);
+	ecsArenaFree();
+	ecsFreeChunkPool();
 
 	ecsIsInit = 0;
 }
 
+ecsWorld* ecsCreateWorld(const ecsConfig* config)
+{
+	const ecsAllocator* allocator = config != NULL && config->allocator != NULL ? config->allocator : &ecsDefaultAllocator;
+	ecsWorld* world = allocator->allocate(allocator->user, sizeof(ecsWorld));
+	if(world == NULL) return NULL;
+	memset(world, 0x0, sizeof(ecsWorld));
+	
+	ecsWorld* previous = ecsSetCurrentWorld(world);
+	int initialized = ecsInitEx(config);
+	ecsSetCurrentWorld(previous);
+	
+	if(!initialized)
+	{
+		allocator->release(allocator->user, world);
+		return NULL;
+	}
+	return world;
+}
+
+void ecsDestroyWorld(ecsWorld* world)
+{
+	assert(world != NULL && world != &ecsDefaultWorld && world != ecsCurrentWorld);
+	
+	ecsWorld* previous = ecsSetCurrentWorld(world);
+	ecsTerminate();
+	ecsSetCurrentWorld(previous);
+	
+	// the world was allocated with its own allocator
+	ecsAllocator allocator = world->allocator;
+	allocator.release(allocator.user, world);
+}
+
+ecsWorld* ecsSetCurrentWorld(ecsWorld* world)
+{
+	assert(ecsThreadCommands == NULL);
+	
+	ecsWorld* previous = ecsCurrentWorld;
+	ecsCurrentWorld = world != NULL ? world : &ecsDefaultWorld;
+	return previous;
+}
+
+ecsWorld* ecsGetCurrentWorld()
+{
+	return ecsCurrentWorld;
+}
+
+void ecsShrinkToFit()
+{
+	assert(ecsIsInit);
+	
+	ecsTrimArchetypes();
+	
+	ecsEntities.begin = ecsShrink(ecsEntities.begin, &ecsEntities.capacity, ecsEntities.size, sizeof(ECSentityData));
+	ecsComponents.begin = ecsShrink(ecsComponents.begin, &ecsComponents.capacity, ecsComponents.size, sizeof(ECScomponentType));
+	ecsArchetypes.begin = ecsShrink(ecsArchetypes.begin, &ecsArchetypes.capacity, ecsArchetypes.size, sizeof(ECSarchetype*));
+	ecsSystems.begin = ecsShrink(ecsSystems.begin, &ecsSystems.capacity, ecsSystems.size, sizeof(ECSsystem));
+	ecsTasks.begin = ecsShrink(ecsTasks.begin, &ecsTasks.capacity, ecsTasks.size, sizeof(ecsTask));
+	
+	// scratch buffers used while running systems
+	ECSviewList* views;
+	ECSsystemState* state;
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		views = &ecsSystems.begin[i].state->views;
+		views->begin = ecsShrink(views->begin, &views->capacity, 0, sizeof(ECSchunkView));
+		views->size = 0;
+		
+		state = ecsSystems.begin[i].state;
+		state->candidates.begin = ecsShrink(state->candidates.begin, &state->candidates.capacity, 0, sizeof(ECSchunkView));
+		state->candidates.size = 0;
+		state->rowBits = ecsShrink(state->rowBits, &state->rowWordCapacity, 0, sizeof(uint64_t));
+		state->candidateWords = ecsShrink(state->candidateWords, &state->candidateCapacity, 0, sizeof(size_t));
+		state->matches = ecsShrink(state->matches, &state->matchCapacity, state->matchCount, sizeof(ECSarchetype*));
+	}
+	ECScommandBuffer* commands;
+	for(size_t i = 0; ecsWorkers.commands != NULL && i <= ecsWorkers.size; i++)
+	{
+		commands = ecsWorkers.commands + i;
+		commands->tasks.begin = ecsShrink(commands->tasks.begin, &commands->tasks.capacity, 0, sizeof(ecsTask));
+		commands->segments = ecsShrink(commands->segments, &commands->segmentCapacity, 0, sizeof(ECScommandSegment));
+	}
+	
+	ecsTrimChunkPool();
+	ecsArenaFree();
+	
+	ecsFree(ecsDetachBatch.begin);
+	ecsFree(ecsDetachBatch.slots);
+	ecsDetachBatch.begin = NULL;
+	ecsDetachBatch.slots = NULL;
+	ecsDetachBatch.capacity = ecsDetachBatch.slotCapacity = 0;
+}
+
+/**
+ * \brief Keeps a component type out of archetypes so attaching and detaching it only flips a bit.
+ */
+static void ecsAddTagType(ecsComponentMask mask)
+{
+	ecsComponents.tags = ecsMaskOr(ecsComponents.tags, mask);
+	
+	// queries involving the tag may match archetypes they were tested against before
+	for(size_t i = 0; i < ecsSystems.size; i++)
+		ecsSystems.begin[i].state->archetypesSeen = ecsSystems.begin[i].state->matchCount = 0;
+}
+
 ecsComponentMask ecsMakeComponentType(size_t stride)
+{
+	// components stay packed, only column starts get the default alignment
+	return ecsMakeAlignedComponentType(stride, 1);
+}
+
+ecsComponentMask ecsMakeAlignedComponentType(size_t stride, size_t alignment)
 {
 	// avoid going out of bounds on the bitmask
-	if (ecsComponents.size == sizeof(ecsComponentMask) * 8) return nocomponent;
+	if (ecsComponents.size == ECS_MAX_COMPONENTS) return nocomponent;
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > ECS_MAX_COMPONENT_ALIGN) return nocomponent;
+	if (stride % alignment != 0) return nocomponent;
 	
-	ecsComponentMask mask = (0x1ll << ecsComponents.size); // calculate component mask
+	// columns are always aligned to ECS_COLUMN_ALIGN, each component only needs its own alignment
+	alignment = alignment > ECS_COLUMN_ALIGN ? alignment : ECS_COLUMN_ALIGN;
+	
+	ecsComponentMask mask = ecsMaskBit(ecsComponents.size); // calculate component mask
 
 	// add an element to end of array
 	if(ecsResizeComponents(ecsComponents.size + 1))
 	{
 		ECScomponentType ntype = (ECScomponentType) { // prepare specs of new component type
-			.size = 0, .begin = NULL, .id = mask, .stride = (stride + sizeof(ecsEntityId)), .componentSize = stride
+			.id = mask, .componentSize = stride, .alignment = alignment
 		};
 		// copy prepared component data
 		memmove(ecsComponents.begin + ecsComponents.size-1, &ntype, sizeof(ntype));
+		ecsComponents.registered = ecsMaskOr(ecsComponents.registered, mask);
+		if(stride == 0)
+			ecsAddTagType(mask);
 		return mask;
 	}
 	
 	return nocomponent;
 }
 
-//
-// COMPONENTS
-//
-
-void ecsSortComponents(ECScomponentType* type)
+static inline ecsComponentMask ecsRegisteredComponents()
 {
-	int swaps;
-	void* a;
-	void* b;
-	ecsEntityId enta;
-	ecsEntityId entb;
-	void* temp = malloc(type->stride);
-	
-	// linear sort
-	do {
-		swaps = 0;
-		for(size_t i = 1; i < type->size; ++i)
-		{
-			a = ((BYTE*)type->begin) + type->stride * (i-1);
-			b = ((BYTE*)type->begin) + type->stride * i;
-			enta = *(ecsEntityId*)a;
-			entb = *(ecsEntityId*)b;
-			
-			if(enta > entb)
-			{
-				swaps++;
-				memcpy(temp, b, type->stride);
-				memcpy(b, a, type->stride);
-				memcpy(a, temp, type->stride);
-			}
-		}
-	} while(swaps > 0);
+	return ecsComponents.registered;
 }
 
-void* ecsGetComponentPtr(ecsEntityId e, ecsComponentMask c)
+/**
+ * \brief Finds the index of the first component type in mask at or after from.
+ * \returns The index of the component type, ECS_MAX_COMPONENTS if there is none.
+ */
+static inline size_t ecsMaskNext(const ecsComponentMask* mask, size_t from)
 {
-	ECScomponentType* ctype = ecsFindComponentType(c);
-	
-	ecsEntityId* ptr = ecsFindComponentFor(ctype, e);
-	if(ptr == NULL) return NULL; // component for e, c combination does not exist
-	
-	return (void*)(ptr + 1);
+	const unsigned long long* words = ecsMaskWords(mask);
+	unsigned long long bits;
+	for(size_t word = from / 64; word < ECS_MASK_WORDS; word++)
+	{
+		bits = words[word];
+		if(word == from / 64)
+			bits &= ~0x0ull << (from % 64);
+		if(bits != 0)
+			return word * 64 + (size_t)__builtin_ctzll(bits);
+	}
+	return ECS_MAX_COMPONENTS;
 }
 
-void ecsAttachComponent(ecsEntityId e, ecsComponentMask c)
+static int ecsGrowSlotSet(ECSslotSet* set, size_t wordCount)
 {
-	ECSentityData* entity = ecsFindEntityData(e);
-	ECScomponentType* ctype = ecsFindComponentType(c);
+	size_t capacity = set->wordCapacity > 0 ? set->wordCapacity : 64;
+	while(capacity < wordCount)
+		capacity *= 2;
 	
-	if(ctype == NULL) return;					// component type does not exist
-	if(entity == NULL) return;					// no such entity
-	if(((entity->mask) & c) != 0) return;		// component already exists
+	uint64_t* words = ecsRealloc(set->words, capacity * sizeof(uint64_t));
+	if(words == NULL) return 0;
+	set->words = words;
+	uint64_t* summary = ecsRealloc(set->summary, capacity / 64 * sizeof(uint64_t));
+	if(summary == NULL) return 0;
+	set->summary = summary;
 	
-	if(ecsResizeComponentType(ctype, ctype->size + 1))
-	{
-		BYTE* eid = ((BYTE*)ctype->begin) + ((ctype->size-1) * ctype->stride); // get last item of the list as its entityId block
-		memset(eid, 0x0, ctype->stride);			// zero new component
-		memcpy(eid, &e, sizeof(ecsEntityId));		// set entityId block
-		entity->mask |= c;							// register that component was added to entity
-		ecsSortComponents(ctype);
-	}
+	memset(words + set->wordCapacity, 0x0, (capacity - set->wordCapacity) * sizeof(uint64_t));
+	memset(summary + set->wordCapacity / 64, 0x0, (capacity - set->wordCapacity) / 64 * sizeof(uint64_t));
+	set->wordCapacity = capacity;
+	return 1;
 }
 
-void ecsAttachComponents(ecsEntityId e, ecsComponentMask q)
+static inline void ecsAddSlot(ECSslotSet* set, size_t slot)
 {
-	ecsComponentMask c; // single component mask
-	for(size_t i = 0; i < ecsComponents.size; i++)
+	size_t word = slot / 64;
+	if(word >= set->wordCapacity && !ecsGrowSlotSet(set, word + 1))
 	{
-		c = (0x1ll << i);
-		if((q & c) != 0) // query contains this mask
-			ecsAttachComponent(e, c);
+		set->incomplete = 1;
+		return;
 	}
+	
+	uint64_t bit = 0x1ull << (slot % 64);
+	if(set->words[word] & bit) return;
+	set->words[word] |= bit;
+	set->summary[word / 64] |= 0x1ull << (word % 64);
+	set->count++;
 }
 
-void ecsDetachComponent(ecsEntityId e, ecsComponentMask c)
+static inline void ecsRemoveSlot(ECSslotSet* set, size_t slot)
 {
-	ECScomponentType* ctype = ecsFindComponentType(c);
-
-	if(ctype == NULL) return;			// no such component type
+	size_t word = slot / 64;
+	uint64_t bit = 0x1ull << (slot % 64);
+	if(word >= set->wordCapacity || !(set->words[word] & bit)) return;
 	
-	ECSentityData* entity = ecsFindEntityData(e);
+	set->words[word] &= ~bit;
+	if(set->words[word] == 0)
+		set->summary[word / 64] &= ~(0x1ull << (word % 64));
+	set->count--;
+}
 
-	if(entity == NULL) return;			// no such entity
-	if((entity->mask & c) == 0) return;	// entity does not have component
+/**
+ * \brief Updates the tag index for an entity slot whose mask changes from one mask to another.
+ */
+static inline void ecsIndexTags(size_t slot, ecsComponentMask from, ecsComponentMask to)
+{
+	ecsComponentMask added = ecsMaskAnd(ecsMaskAndNot(to, from), ecsComponents.tags);
+	ecsComponentMask removed = ecsMaskAnd(ecsMaskAndNot(from, to), ecsComponents.tags);
 	
-	void* block = ecsFindComponentFor(ctype, e);
+	for(size_t i = ecsMaskNext(&added, 0); i < ECS_MAX_COMPONENTS; i = ecsMaskNext(&added, i + 1))
+		ecsAddSlot(&ecsComponents.begin[i].slots, slot);
+	for(size_t i = ecsMaskNext(&removed, 0); i < ECS_MAX_COMPONENTS; i = ecsMaskNext(&removed, i + 1))
+		ecsRemoveSlot(&ecsComponents.begin[i].slots, slot);
+}
 
-	if(block == NULL) return;			// no component block for entity found
-	
-	uintptr_t lenafter = (uintptr_t)(((BYTE*)ctype->begin + ctype->size * ctype->stride) - (BYTE*)block);
-	lenafter -= ctype->stride;
-	// move last element into to-be-destroyed element
-	memmove(block, block + ctype->stride, lenafter);
-	
-	// shorten array by one stride
-	ecsResizeComponentType(ctype, (ctype->size)-1);
-	entity->mask &= ~c;
+static inline int ecsMaskTest(const ecsComponentMask* mask, size_t index)
+{
+	return (ecsMaskWords(mask)[index / 64] >> (index % 64)) & 0x1;
 }
 
-void ecsDetachComponents(ecsEntityId e, ecsComponentMask c)
-{ ecsPushTask((ecsTask){.type=ECS_COMPONENTS_DETACH, .components={ .mask=c }, .entity=e}); }
-void ecsTaskDetachComponents(ecsEntityId e, ecsComponentMask q)
+/**
+ * \brief Finds the initial value given for a component type.
+ * \param init One pointer per component type in mask, in order of component type, or NULL.
+ * \returns NULL if type is not in mask or no value was given.
+ */
+static inline const void* ecsInitialValue(size_t type, const ecsComponentMask* mask, const void* const* init)
 {
-	ecsComponentMask id;
-	for(size_t i = 0; i < ecsComponents.size; i++)
-	{
-		id = (0x1ll << i);
-		if((q & id) != 0) // query contains component type at i
-			ecsDetachComponent(e, id);
-	}
+	if(init == NULL) return NULL;
+	
+	if(!ecsMaskTest(mask, type)) return NULL;
+	
+	const unsigned long long* words = ecsMaskWords(mask);	
+	// the pointer index is the number of mask bits below type
+	size_t rank = (size_t)__builtin_popcountll(words[type / 64] & ((0x1ull << (type % 64)) - 1));
+	for(size_t word = 0; word < type / 64; word++)
+		rank += (size_t)__builtin_popcountll(words[word]);
+	return init[rank];
 }
 
 //
-// ENTITIES
+// ARCHETYPES
 //
 
-ecsEntityId ecsCreateEntity(ecsComponentMask components)
+static inline ecsEntityId* ecsArchetypeEntity(ECSarchetype* archetype, size_t row)
 {
-	// register an id that is unique for the runtime of the ecs
-	ecsEntityId id = ecsEntities.nextValidId;
-	ecsEntities.nextValidId++;
-	
-	// prepare values
-	ECSentityData entity = (ECSentityData) {
-		.mask = 0x0, .id = id
-	};
-	
-	// resize entities list
-	if(ecsResizeEntities(ecsEntities.size + 1))
-	{
-		// copy prepared values
-		memmove((ecsEntities.begin + ecsEntities.size - 1), &entity, sizeof(entity));
-		
-		// attach requested components
-		ecsAttachComponents(id, components);
-		return id;
-	}
-	return noentity;
+	ECSchunk* chunk = archetype->chunks + (row / archetype->chunkCapacity);
+	return ((ecsEntityId*)chunk->data) + (row % archetype->chunkCapacity);
 }
 
-ecsEntityId ecsGetComponentMask(ecsEntityId entity)
+static inline ecsComponentMask* ecsChunkMasks(ECSarchetype* archetype, ECSchunk* chunk)
 {
-	ECSentityData* data = ecsFindEntityData(entity);
-	return data != NULL ? data->mask : nocomponent;
+	return (ecsComponentMask*)(chunk->data + archetype->chunkCapacity * sizeof(ecsEntityId));
 }
 
-int ecsValidEntity(ecsEntityId entity)
+static inline ecsComponentMask* ecsArchetypeMask(ECSarchetype* archetype, size_t row)
 {
-	return ecsFindEntityData(entity) != NULL;
+	return ecsChunkMasks(archetype, archetype->chunks + (row / archetype->chunkCapacity)) + (row % archetype->chunkCapacity);
 }
 
-void ecsDestroyEntity(ecsEntityId e)
-{ ecsPushTask((ecsTask){.type=ECS_ENTITY_DESTROY, .entity=e}); }
-void ecsTaskDestroyEntity(ecsEntityId e)
+static inline BYTE* ecsArchetypeComponent(ECSarchetype* archetype, size_t column, size_t row)
 {
-	ECSentityData* data = ecsFindEntityData(e);
-	if(data == NULL) return; // no such entity
-	
-	// destroy all components owned by entity
-	ecsTaskDetachComponents(e, data->mask);
-	
-	// get the last element of the entities array
-	uintptr_t countAfter = (uintptr_t)((ecsEntities.begin + ecsEntities.size) - data);
-	assert(countAfter < ecsEntities.size);
-	// copy last into to-be-deleted entity
-	memmove(data, data+1, sizeof(ECSentityData) * countAfter);
+	ECSchunk* chunk = archetype->chunks + (row / archetype->chunkCapacity);
+	ECScolumn* col = archetype->columns + column;
+	return chunk->data + col->offset + (row % archetype->chunkCapacity) * col->size;
+}
 
-	// resize
-	ecsResizeEntities(ecsEntities.size - 1);
+static inline atomic_size_t* ecsChunkTicks(ECSarchetype* archetype, ECSchunk* chunk)
+{
+	return (atomic_size_t*)(chunk->data + archetype->ticksOffset);
 }
 
-//
-// SYSTEMS
-//
+/**
+ * \brief The tick to stamp changes made right now with.
+ * \note Systems use the tick they started at, changes made outside systems are new to every system that ran so far.
+ */
+static inline size_t ecsCurrentTick()
+{
+	if(ecsThreadCommands != NULL)
+		return ecsSystems.begin[ecsThreadSystem].state->changeTick;
+	return atomic_load_explicit(&ecsChangeTick, memory_order_relaxed) + 1;
+}
 
-int matchQuery(ecsComponentQuery query, ecsComponentMask mask)
+static inline void ecsRaiseTick(atomic_size_t* changed, size_t tick)
 {
-	if(query.comparison == ECS_QUERY_ANY)
-		return (mask & query.mask) != 0;
-	else if(query.comparison == ECS_QUERY_ALL)
-		return (mask & query.mask) == query.mask;
-	return 0;
+	// relaxed is enough, systems stamping the same column never depend on each other's stamps
+	if(atomic_load_explicit(changed, memory_order_relaxed) < tick)
+		atomic_store_explicit(changed, tick, memory_order_relaxed);
 }
 
-typedef struct ecsRunSystemArgs {
-	ecsSystemFn fn;
-	ecsEntityId* entities;
-	ecsComponentMask* components;
-	size_t count;
-	float deltaTime;
-} ecsRunSystemArgs;
+/**
+ * \brief Marks a column of the chunk holding row as changed at tick.
+ */
+static inline void ecsMarkChanged(ECSarchetype* archetype, size_t column, size_t row, size_t tick)
+{
+	ecsRaiseTick(ecsChunkTicks(archetype, archetype->chunks + (row / archetype->chunkCapacity)) + column, tick);
+}
 
-void* ecsRunSystem(void* args)
+static inline size_t ecsChangedAt(ECSarchetype* archetype, size_t column, size_t row)
 {
-	ecsRunSystemArgs* arg = args;
-	arg->fn(arg->entities, arg->components, arg->count, arg->deltaTime);
-	return NULL;
+	atomic_size_t* ticks = ecsChunkTicks(archetype, archetype->chunks + (row / archetype->chunkCapacity)) + column;
+	return atomic_load_explicit(ticks, memory_order_relaxed);
 }
 
-void ecsRunSystems(float deltaTime)
+static inline size_t ecsHashMask(ecsComponentMask mask)
+{
+	// fibonacci hashing, folded so the low bits used for indexing depend on every bit of the mask
+	const unsigned long long* words = ecsMaskWords(&mask);
+	unsigned long long hash = 0;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++)
+		hash = (hash ^ words[i]) * 0x9E3779B97F4A7C15ull;
+	return (size_t)(hash ^ (hash >> 32));
+}
+
+/**
+ * \brief Inserts an archetype into the lookup table, which must have a free slot.
+ */
+static inline void ecsMapArchetype(ECSarchetype* archetype)
+{
+	size_t last = ecsArchetypes.mapCapacity - 1;
+	size_t slot = ecsHashMask(archetype->mask) & last;
+	while(ecsArchetypes.map[slot] != NULL)
+		slot = (slot + 1) & last;
+	ecsArchetypes.map[slot] = archetype;
+}
+
+static ECSarchetype* ecsMakeArchetype(ecsComponentMask mask)
 {
-	ECSsystem system;
-	ECSentityData entity;
-	size_t entityCount = ecsEntities.size;
+	ECSarchetype* archetype = ecsMalloc(sizeof(ECSarchetype));
+	if(archetype == NULL) return NULL;
+	memset(archetype, 0x0, sizeof(ECSarchetype));
+	archetype->mask = mask;
 	
-	pthread_t* threads = NULL;
-	ecsRunSystemArgs* threadArgs = NULL;
+	// count columns and the number of bytes a single row occupies
+	size_t rowSize = sizeof(ecsEntityId) + sizeof(ecsComponentMask);
+	size_t padding = sizeof(atomic_size_t);
+	for(size_t i = 0; i < ECS_MAX_COMPONENTS; i++)
+		archetype->columnOf[i] = -1;
+	for(size_t i = ecsMaskNext(&mask, 0); i < ecsComponents.size; i = ecsMaskNext(&mask, i + 1))
+	{
+		archetype->columnOf[i] = (int)archetype->columnCount++;
+		rowSize += ecsComponents.begin[i].componentSize;
+		padding += ecsComponents.begin[i].alignment + sizeof(atomic_size_t);
+	}
 	
-	for(size_t i = 0; i < ecsSystems.size; ++i)
+	// fit as many rows into a chunk as possible, leaving room for column alignment and the change ticks
+	size_t capacity = 1;
+	if(ECS_CHUNK_SIZE > padding + rowSize)
+		capacity = (ECS_CHUNK_SIZE - padding) / rowSize;
+	archetype->chunkCapacity = capacity;
+	
+	archetype->columns = ecsMalloc((archetype->columnCount + 1) * sizeof(ECScolumn));
+	if(archetype->columns == NULL)
+	{
+		ecsFree(archetype);
+		return NULL;
+	}
+	
+	// lay out columns after the entity id and mask arrays
+	size_t offset = capacity * (sizeof(ecsEntityId) + sizeof(ecsComponentMask));
+	for(size_t i = ecsMaskNext(&mask, 0); i < ecsComponents.size; i = ecsMaskNext(&mask, i + 1))
 	{
-		system = ecsSystems.begin[i];
+		int column = archetype->columnOf[i];
+		size_t alignment = ecsComponents.begin[i].alignment;
 		
-		// ECS_NOQUERY systems get run exactly once per ecsRunSystems call
-		// with entity and components arguments on NULL
-		// and count argument on 0
-		if(system.query.comparison == ECS_NOQUERY)
+		offset = (offset + alignment - 1) & ~(alignment - 1);
+		archetype->columns[column] = (ECScolumn) {
+			.type = i, .offset = offset, .size = ecsComponents.begin[i].componentSize
+		};
+		offset += capacity * ecsComponents.begin[i].componentSize;
+	}
+	
+	// change ticks go after the rows, chunks that fit are all the same size so the chunk pool can recycle them
+	archetype->ticksOffset = (offset + sizeof(atomic_size_t) - 1) & ~(sizeof(atomic_size_t) - 1);
+	archetype->chunkBytes = archetype->ticksOffset + archetype->columnCount * sizeof(atomic_size_t);
+	if(archetype->chunkBytes < ECS_CHUNK_SIZE)
+		archetype->chunkBytes = ECS_CHUNK_SIZE;
+	
+	if(!ecsResizeArchetypes(ecsArchetypes.size + 1))
+	{
+		ecsFree(archetype->columns);
+		ecsFree(archetype);
+		return NULL;
+	}
+	ecsArchetypes.begin[ecsArchetypes.size - 1] = archetype;
+	
+	// keep the lookup table at most half full
+	if(ecsArchetypes.size * 2 > ecsArchetypes.mapCapacity)
+	{
+		if(!ecsResizeArchetypeMap(ecsArchetypes.size * 2))
 		{
-			system.fn(NULL, NULL, 0, deltaTime);
+			ecsArchetypes.size--;
+			ecsFree(archetype->columns);
+			ecsFree(archetype);
+			return NULL;
 		}
-		else
+	}
+	else
+		ecsMapArchetype(archetype);
+	
+	if(ecsTracer.capacity > 0)
+		ecsTrace(0, "archetype created", 0, ecsNow(), ECS_TRACE_INSTANT, archetype->columnCount);
+	return archetype;
+}
+
+/**
+ * \brief Finds or makes the archetype storing entities with mask.
+ * \note Tags do not take part in archetypes, entities only differing in tags share one.
+ */
+static inline ECSarchetype* ecsGetArchetype(ecsComponentMask mask)
+{
+	mask = ecsMaskAndNot(mask, ecsComponents.tags);
+	ECSarchetype* archetype = ecsFindArchetype(mask);
+	return archetype != NULL ? archetype : ecsMakeArchetype(mask);
+}
+
+/**
+ * \brief Appends a row for id with mask to the end of archetype.
+ * \note Component data of the new row is left uninitialized.
+ */
+static inline int ecsArchetypePush(ECSarchetype* archetype, ecsEntityId id, ecsComponentMask mask, size_t* row)
+{
+	size_t chunkIndex = archetype->count / archetype->chunkCapacity;
+	if(chunkIndex == archetype->chunkCount && !ecsResizeChunks(archetype, archetype->chunkCount + 1))
+		return 0;
+	
+	ECSchunk* chunk = archetype->chunks + chunkIndex;
+	((ecsEntityId*)chunk->data)[chunk->count] = id;
+	ecsChunkMasks(archetype, chunk)[chunk->count] = mask;
+	chunk->count++;
+	
+	*row = archetype->count;
+	archetype->count++;
+	return 1;
+}
+
+/**
+ * \brief Removes a row from archetype by moving the last row into it.
+ * \note Emptied chunks are kept for reuse until ecsShrinkToFit, so pointers handed to systems stay valid.
+ */
+static inline void ecsArchetypeRemove(ECSarchetype* archetype, size_t row)
+{
+	size_t last = archetype->count - 1;
+	
+	if(row != last)
+	{
+		ecsEntityId moved = *ecsArchetypeEntity(archetype, last);
+		*ecsArchetypeEntity(archetype, row) = moved;
+		*ecsArchetypeMask(archetype, row) = *ecsArchetypeMask(archetype, last);
+		for(size_t i = 0; i < archetype->columnCount; i++)
 		{
-			// look for all entities matching the query
-			// first allocate entity and component lists the size of the number of entities
-			ecsEntityId* entityList = malloc((entityCount + 1) * sizeof(ecsEntityId));
-			ecsComponentMask* componentList = malloc((entityCount + 1) * sizeof(ecsComponentMask));
-			assert(entityList != NULL);
-			assert(componentList != NULL);
+			memcpy(ecsArchetypeComponent(archetype, i, row), ecsArchetypeComponent(archetype, i, last), archetype->columns[i].size);
+			ecsMarkChanged(archetype, i, row, ecsChangedAt(archetype, i, last));
+		}
+		
+		ECSentityData* data = ecsFindEntityData(moved);
+		assert(data != NULL);
+		data->row = row;
+	}
+	
+	archetype->chunks[last / archetype->chunkCapacity].count--;
+	archetype->count--;
+}
 
-			// then search for entities that match the query
-			size_t total = 0;
-			for(size_t j = 0; j < entityCount; ++j)
-			{
-				entity = ecsEntities.begin[j];
-				if (matchQuery(system.query, entity.mask))
-				{
-					assert(total < entityCount);
-					entityList[total]		= entity.id;
-					componentList[total]	= entity.mask;
-					total++;
-				}
-			}
+/**
+ * \brief Gives an entity a new mask, moving it into another archetype if its components other than tags change.
+ * \param to The archetype for mask, as returned by ecsGetArchetype.
+ * \param initMask, init Initial values for components in initMask, see ecsInitialValue. These replace kept values.
+ * \note Components that are new to the entity and have no initial value are zeroed.
+ * Changes to kept components are carried over, the others count as changed.
+ */
+static int ecsMoveEntity(ECSentityData* entity, ECSarchetype* to, ecsComponentMask mask, const ecsComponentMask* initMask, const void* const* init)
+{
+	ECSarchetype* from = entity->archetype;
+	size_t row;
+	
+	if(to == NULL) return 0;
+	if(to == from)
+	{
+		// only tags changed, initial values still replace kept ones
+		for(size_t i = 0; init != NULL && i < from->columnCount; i++)
+		{
+			const void* value = ecsInitialValue(from->columns[i].type, initMask, init);
+			if(value == NULL) continue;
 			
-			size_t threadCount = system.maxThreads;
-			if(threadCount > 0)
-				threadCount = threadCount > total ? total : threadCount;
-			else
-				threadCount = 1;
+			memcpy(ecsArchetypeComponent(from, i, entity->row), value, from->columns[i].size);
+			ecsMarkChanged(from, i, entity->row, ecsCurrentTick());
+		}
+		ecsIndexTags(ecsEntityIndex(entity->id), entity->mask, mask);
+		entity->mask = mask;
+		*ecsArchetypeMask(from, entity->row) = mask;
+		return 1;
+	}
+	if(!ecsArchetypePush(to, entity->id, mask, &row)) return 0;
+	
+	size_t tick = ecsCurrentTick();
+	for(size_t i = 0; i < to->columnCount; i++)
+	{
+		BYTE* dst = ecsArchetypeComponent(to, i, row);
+		const void* value = ecsInitialValue(to->columns[i].type, initMask, init);
+		int src = from->columnOf[to->columns[i].type];
+		if(value == NULL && src >= 0)
+		{
+			memcpy(dst, ecsArchetypeComponent(from, src, entity->row), to->columns[i].size);
+			ecsMarkChanged(to, i, row, ecsChangedAt(from, src, entity->row));
+			continue;
+		}
+		
+		if(value != NULL)
+			memcpy(dst, value, to->columns[i].size);
+		else
+			memset(dst, 0x0, to->columns[i].size);
+		ecsMarkChanged(to, i, row, tick);
+	}
+	
+	ecsArchetypeRemove(from, entity->row);
+	ecsIndexTags(ecsEntityIndex(entity->id), entity->mask, mask);
+	entity->archetype = to;
+	entity->row = row;
+	entity->mask = mask;
+	return 1;
+}
 
-			// dont use threads
-			if(threadCount <= 1)
-			{
-				system.fn(entityList, componentList, total, deltaTime);
-			}
-			// use threads
+//
+// COMPONENTS
+//
+
+void* ecsGetComponentPtr(ecsEntityId e, ecsComponentMask c)
+{
+	ECScomponentType* ctype = ecsFindComponentType(c);
+	ECSentityData* entity = ecsFindEntityData(e);
+	
+	if(ctype == NULL) return NULL;		// component type does not exist
+	if(entity == NULL) return NULL;		// no such entity
+	
+	int column = entity->archetype->columnOf[ctype - ecsComponents.begin];
+	if(column < 0) return NULL;			// component for e, c combination does not exist
+	
+	// the caller may write through the pointer
+	ecsMarkChanged(entity->archetype, (size_t)column, entity->row, ecsCurrentTick());
+	return ecsArchetypeComponent(entity->archetype, column, entity->row);
+}
+
+const void* ecsReadComponentPtr(ecsEntityId e, ecsComponentMask c)
+{
+	ECScomponentType* ctype = ecsFindComponentType(c);
+	ECSentityData* entity = ecsFindEntityData(e);
+	
+	if(ctype == NULL) return NULL;		// component type does not exist
+	if(entity == NULL) return NULL;		// no such entity
+	
+	int column = entity->archetype->columnOf[ctype - ecsComponents.begin];
+	if(column < 0) return NULL;			// component for e, c combination does not exist
+	
+	return ecsArchetypeComponent(entity->archetype, column, entity->row);
+}
+
+void ecsAttachComponent(ecsEntityId e, ecsComponentMask c)
+{
+	ECSentityData* entity = ecsFindEntityData(e);
+	ECScomponentType* ctype = ecsFindComponentType(c);
+	
+	if(ctype == NULL) return;					// component type does not exist
+	if(entity == NULL) return;					// no such entity
+	if(ecsMaskIntersects(entity->mask, c)) return;	// component already exists
+	
+	ecsComponentMask mask = ecsMaskOr(entity->mask, c);
+	ecsMoveEntity(entity, ecsGetArchetype(mask), mask, NULL, NULL);
+}
+
+void ecsAttachComponents(ecsEntityId e, ecsComponentMask q)
+{
+	ECSentityData* entity = ecsFindEntityData(e);
+	
+	if(entity == NULL) return;					// no such entity
+	
+	q = ecsMaskAnd(q, ecsRegisteredComponents());
+	if(ecsMaskContains(entity->mask, q)) return; // all components already exist
+	
+	// move to the archetype containing all requested components at once
+	ecsComponentMask mask = ecsMaskOr(entity->mask, q);
+	ecsMoveEntity(entity, ecsGetArchetype(mask), mask, NULL, NULL);
+}
+
+void ecsAttachComponentWithData(ecsEntityId e, ecsComponentMask c, const void* data)
+{ ecsAttachComponentsWithData(e, c, &data); }
+void ecsAttachComponentsWithData(ecsEntityId e, ecsComponentMask q, const void* const* data)
+{
+	ECSentityData* entity = ecsFindEntityData(e);
+	
+	if(entity == NULL) return;					// no such entity
+	
+	// data is indexed by the bits of the mask as given
+	ecsComponentMask attach = ecsMaskAnd(q, ecsRegisteredComponents());
+	if(!ecsMaskContains(entity->mask, attach))
+	{
+		ecsComponentMask mask = ecsMaskOr(entity->mask, attach);
+		ecsMoveEntity(entity, ecsGetArchetype(mask), mask, &q, data);
+		return;
+	}
+	
+	// all components already exist, overwrite them in place
+	ECSarchetype* archetype = entity->archetype;
+	const void* value;
+	size_t column;
+	for(size_t i = ecsMaskNext(&attach, 0); i < ECS_MAX_COMPONENTS; i = ecsMaskNext(&attach, i + 1))
+	{
+		value = ecsInitialValue(i, &q, data);
+		if(value == NULL || archetype->columnOf[i] < 0) continue;	// tags have no column
+		
+		column = (size_t)archetype->columnOf[i];
+		memcpy(ecsArchetypeComponent(archetype, column, entity->row), value, ecsComponents.begin[i].componentSize);
+		ecsMarkChanged(archetype, column, entity->row, ecsCurrentTick());
+	}
+}
+
+void ecsAttachComponentsBulk(const ecsEntityId* entities, size_t count, ecsComponentMask q)
+{
+	q = ecsMaskAnd(q, ecsRegisteredComponents());
+	if(count == 0 || ecsMaskIsEmpty(q)) return;
+	
+	// attach one by one if there is no room to sort
+	size_t mark = ecsArena.used;
+	ecsEntityId* keys = ecsArenaPush(count * sizeof(ecsEntityId));
+	ecsEntityId* swap = ecsArenaPush(count * sizeof(ecsEntityId));
+	if(keys == NULL || swap == NULL)
+	{
+		ecsArenaRelease(mark);
+		for(size_t i = 0; i < count; i++)
+			ecsAttachComponents(entities[i], q);
+		return;
+	}
+	
+	// visit entities in slot order so the entity index is read front to back
+	memcpy(keys, entities, count * sizeof(ecsEntityId));
+	ecsEntityId* sorted = ecsRadixSortEntities(keys, swap, count);
+	
+	ECSarchetype* from = NULL;
+	ECSarchetype* to = NULL;
+	ECSentityData* entity;
+	for(size_t i = 0; i < count; i++)
+	{
+		entity = ecsFindEntityData(sorted[i]);
+		
+		if(entity == NULL) continue;							// no such entity
+		if(ecsMaskContains(entity->mask, q)) continue;			// already attached, also skips duplicates
+		
+		// entities spawned together share an archetype, only look up the destination when it changes
+		if(entity->archetype != from)
+		{
+			from = entity->archetype;
+			to = ecsGetArchetype(ecsMaskOr(from->mask, q));
+		}
+		ecsMoveEntity(entity, to, ecsMaskOr(entity->mask, q), NULL, NULL);
+	}
+	ecsArenaRelease(mark);
+}
+
+void ecsDetachComponent(ecsEntityId e, ecsComponentMask c)
+{
+	ECScomponentType* ctype = ecsFindComponentType(c);
+
+	if(ctype == NULL) return;			// no such component type
+	
+	ECSentityData* entity = ecsFindEntityData(e);
+
+	if(entity == NULL) return;			// no such entity
+	if(!ecsMaskIntersects(entity->mask, c)) return;	// entity does not have component
+	
+	ecsComponentMask mask = ecsMaskAndNot(entity->mask, c);
+	ecsMoveEntity(entity, ecsGetArchetype(mask), mask, NULL, NULL);
+}
+
+void ecsDetachComponents(ecsEntityId e, ecsComponentMask c)
+{ ecsPushTask((ecsTask){.type=ECS_COMPONENTS_DETACH, .components={ .mask=c }, .entity=e}); }
+void ecsTaskDetachComponents(ecsEntityId e, ecsComponentMask q)
+{
+	ECSentityData* entity = ecsFindEntityData(e);
+	
+	if(entity == NULL) return;			// no such entity
+	if(!ecsMaskIntersects(entity->mask, q)) return;	// entity has none of the components
+	
+	ecsComponentMask mask = ecsMaskAndNot(entity->mask, q);
+	ecsMoveEntity(entity, ecsGetArchetype(mask), mask, NULL, NULL);
+}
+
+//
+// ENTITIES
+//
+
+/**
+ * \brief Sorts entity ids by slot index using a least significant digit radix sort, 8 bits per pass.
+ * \returns keys or swap, whichever holds the sorted ids after the last pass.
+ */
+static ecsEntityId* ecsRadixSortEntities(ecsEntityId* keys, ecsEntityId* swap, size_t count)
+{
+	size_t offsets[256];
+	ecsEntityId* tmp;
+	
+	for(size_t shift = 0; shift < ECS_ENTITY_INDEX_BITS; shift += 8)
+	{
+		memset(offsets, 0x0, sizeof(offsets));
+		for(size_t i = 0; i < count; i++)
+			offsets[(ecsEntityIndex(keys[i]) >> shift) & 0xFF]++;
+		
+		// skip passes where all keys share the same digit
+		if(offsets[(ecsEntityIndex(keys[0]) >> shift) & 0xFF] == count)
+			continue;
+		
+		size_t sum = 0, digitCount;
+		for(size_t d = 0; d < 256; d++)
+		{
+			digitCount = offsets[d];
+			offsets[d] = sum;
+			sum += digitCount;
+		}
+		for(size_t i = 0; i < count; i++)
+			swap[offsets[(ecsEntityIndex(keys[i]) >> shift) & 0xFF]++] = keys[i];
+		
+		tmp = keys;
+		keys = swap;
+		swap = tmp;
+	}
+	return keys;
+}
+
+/**
+ * \brief Turns slots reserved by ecsCreateEntitiesDeferred into part of the entities list.
+ * \note The slots stay invalid until their creation task runs.
+ */
+static int ecsClaimReservedSlots()
+{
+	size_t reserved = atomic_exchange(&ecsEntities.reserved, 0);
+	if(reserved == 0) return 1;
+	
+	size_t first = ecsEntities.size;
+	if(!ecsResizeEntities(first + reserved))
+	{
+		atomic_fetch_add(&ecsEntities.reserved, reserved);
+		return 0;
+	}
+	
+	for(size_t i = first; i < first + reserved; i++)
+	{
+		ecsEntities.begin[i] = (ECSentityData) {
+			.id = ecsMakeEntityId(i, 1), .mask = nocomponent, .archetype = NULL, .row = ECS_RESERVED_SLOT
+		};
+	}
+	if(ecsEntities.unclaimed == ECS_NO_SLOT)
+		ecsEntities.unclaimed = first;
+	return 1;
+}
+
+/**
+ * \brief Puts reserved slots whose creation task never ran on the free list.
+ */
+static void ecsReleaseReservedSlots()
+{
+	if(ecsEntities.unclaimed == ECS_NO_SLOT) return;
+	
+	for(size_t i = ecsEntities.size; i > ecsEntities.unclaimed; i--)
+	{
+		ECSentityData* data = ecsEntities.begin + i - 1;
+		if(data->row != ECS_RESERVED_SLOT) continue;
+		
+		// the id was handed out already, bump the version so that it does not refer to the next entity here
+		ecsEntityId version = ecsEntityVersion(data->id) + 1;
+		if(version > ECS_ENTITY_VERSION_MASK) version = 1;
+		data->id = ecsMakeEntityId(i - 1, version);
+		data->row = ecsEntities.freeList;
+		ecsEntities.freeList = i - 1;
+	}
+	ecsEntities.unclaimed = ECS_NO_SLOT;
+}
+
+/**
+ * \brief Gives the consecutive slots [first, first + count) rows with mask at the end of archetype.
+ * \param initMask, init Arrays of count initial values for components in initMask, see ecsInitialValue.
+ * Components without initial values are zeroed.
+ * \note The slots must have their ids set and be neither in use nor on the free list.
+ * \returns The number of entities placed, less than count if out of memory.
+ */
+static size_t ecsPlaceEntities(ECSarchetype* archetype, ecsComponentMask mask, size_t first, size_t count, const ecsComponentMask* initMask, const void* const* init)
+{
+	size_t capacity = archetype->chunkCapacity;
+	
+	// allocate every chunk needed up front
+	size_t chunks = (archetype->count + count + capacity - 1) / capacity;
+	if(chunks > archetype->chunkCount && !ecsResizeChunks(archetype, chunks))
+	{
+		size_t room = archetype->chunkCount * capacity - archetype->count;
+		count = count < room ? count : room;
+	}
+	
+	size_t tick = ecsCurrentTick();
+	size_t placed = 0;
+	while(placed < count)
+	{
+		// fill the rest of the last chunk in one go
+		size_t row = archetype->count;
+		size_t offset = row % capacity;
+		size_t run = capacity - offset < count - placed ? capacity - offset : count - placed;
+		ECSchunk* chunk = archetype->chunks + row / capacity;
+		ecsEntityId* ids = (ecsEntityId*)chunk->data + offset;
+		ecsComponentMask* masks = ecsChunkMasks(archetype, chunk) + offset;
+		
+		ECSentityData* data = ecsEntities.begin + first + placed;
+		for(size_t i = 0; i < run; i++)
+		{
+			ids[i] = data[i].id;
+			masks[i] = mask;
+			ecsIndexTags(first + placed + i, data[i].mask, mask);
+			data[i].mask = mask;
+			data[i].archetype = archetype;
+			data[i].row = row + i;
+		}
+		for(size_t i = 0; i < archetype->columnCount; i++)
+		{
+			ECScolumn* column = archetype->columns + i;
+			const BYTE* values = ecsInitialValue(column->type, initMask, init);
+			if(values != NULL)
+				memcpy(chunk->data + column->offset + offset * column->size, values + placed * column->size, run * column->size);
 			else
-			{
-				// avoid creating more threads than there are matching entities
-				threads = realloc(threads, threadCount * sizeof(pthread_t));
-				threadArgs = realloc(threadArgs, threadCount * sizeof(ecsRunSystemArgs));
-				
-				// for each thread, create a runsystemargs instance describing it's area of influence
-				// then create the thread
-				size_t perThreadCount = total - (total % (threadCount-1));
-				perThreadCount = perThreadCount / (threadCount-1);
-				size_t remainder = total % (threadCount-1);
-				for(int j = 0; j < threadCount; ++j)
-				{
-					threadArgs[j].fn = system.fn;
-					threadArgs[j].entities = entityList + perThreadCount * j;
-					threadArgs[j].components = componentList + perThreadCount * j;
-					threadArgs[j].count = (j == threadCount-1) ? remainder : perThreadCount;
-					threadArgs[j].deltaTime = deltaTime;
-					
-					pthread_create(threads + j, NULL, &ecsRunSystem, threadArgs + j);
-				}
-				
-				// wait for completion of all threads
-				for(int j = 0; j < threadCount; ++j)
-				{
-					pthread_join(threads[j], NULL);
-				}
-			}
-			
-			// clean up
-			free(entityList);
-			free(componentList);
+				memset(chunk->data + column->offset + offset * column->size, 0x0, run * column->size);
+			ecsRaiseTick(ecsChunkTicks(archetype, chunk) + i, tick);
 		}
+		
+		chunk->count += run;
+		archetype->count += run;
+		placed += run;
+	}
+	return placed;
+}
+
+ecsEntityId ecsCreateEntity(ecsComponentMask components)
+{ return ecsCreateEntityWithData(components, NULL); }
+ecsEntityId ecsCreateEntityWithData(ecsComponentMask components, const void* const* data)
+{
+	ecsComponentMask mask = ecsMaskAnd(components, ecsRegisteredComponents());
+	ECSarchetype* archetype = ecsGetArchetype(mask);
+	if(archetype == NULL) return noentity;
+	
+	// reuse a free slot or grow the entities list by one
+	size_t index = ecsEntities.freeList;
+	if(index == ECS_NO_SLOT)
+	{
+		if(!ecsClaimReservedSlots()) return noentity;
+		index = ecsEntities.size;
+		if(index > ECS_ENTITY_INDEX_MASK) return noentity;
+		if(!ecsResizeEntities(ecsEntities.size + 1)) return noentity;
+		
+		// new slots start at version 1 so that no id equals noentity
+		ecsEntities.begin[index] = (ECSentityData) {
+			.id = ecsMakeEntityId(index, 1), .archetype = NULL, .row = ECS_NO_SLOT
+		};
+		ecsEntities.freeList = index;
+	}
+	
+	ECSentityData* entity = ecsEntities.begin + index;
+	size_t row;
+	if(!ecsArchetypePush(archetype, entity->id, mask, &row)) return noentity;
+	
+	// unlink slot from the free list
+	ecsEntities.freeList = entity->row;
+	ecsIndexTags(index, entity->mask, mask);
+	entity->mask = mask;
+	entity->archetype = archetype;
+	entity->row = row;
+	
+	// copy or zero requested components
+	const void* value;
+	size_t tick = ecsCurrentTick();
+	for(size_t i = 0; i < archetype->columnCount; i++)
+	{
+		value = ecsInitialValue(archetype->columns[i].type, &components, data);
+		if(value != NULL)
+			memcpy(ecsArchetypeComponent(archetype, i, row), value, archetype->columns[i].size);
+		else
+			memset(ecsArchetypeComponent(archetype, i, row), 0x0, archetype->columns[i].size);
+		ecsMarkChanged(archetype, i, row, tick);
+	}
+	
+	return entity->id;
+}
+
+size_t ecsCreateEntities(ecsComponentMask components, size_t count, ecsEntityId* outIds)
+{ return ecsCreateEntitiesWithData(components, count, NULL, outIds); }
+size_t ecsCreateEntitiesWithData(ecsComponentMask components, size_t count, const void* const* data, ecsEntityId* outIds)
+{
+	ecsComponentMask mask = ecsMaskAnd(components, ecsRegisteredComponents());
+	ECSarchetype* archetype = ecsGetArchetype(mask);
+	if(archetype == NULL) return 0;
+	
+	// sizes of the components data points to, in the same order
+	size_t sizes[ECS_MAX_COMPONENTS];
+	const void* values[ECS_MAX_COMPONENTS];
+	size_t valueCount = 0;
+	if(data != NULL)
+	{
+		for(size_t i = ecsMaskNext(&components, 0); i < ECS_MAX_COMPONENTS; i = ecsMaskNext(&components, i + 1))
+			sizes[valueCount++] = i < ecsComponents.size ? ecsComponents.begin[i].componentSize : 0;
+	}
+	
+	// reuse free slots first
+	size_t created = 0;
+	ecsEntityId id;
+	while(created < count && ecsEntities.freeList != ECS_NO_SLOT)
+	{
+		for(size_t i = 0; i < valueCount; i++)
+			values[i] = data[i] != NULL ? (const BYTE*)data[i] + created * sizes[i] : NULL;
+		id = ecsCreateEntityWithData(components, data != NULL ? values : NULL);
+		if(id == noentity) return created;
+		if(outIds) outIds[created] = id;
+		created++;
+	}
+	if(created == count) return created;
+	
+	// grow the entities list once for the rest
+	if(!ecsClaimReservedSlots()) return created;
+	size_t first = ecsEntities.size;
+	size_t fresh = count - created;
+	if(first + fresh - 1 > ECS_ENTITY_INDEX_MASK) return created;
+	if(!ecsResizeEntities(first + fresh)) return created;
+	
+	// new slots start at version 1 so that no id equals noentity
+	for(size_t i = first; i < first + fresh; i++)
+	{
+		ecsEntities.begin[i] = (ECSentityData) {
+			.id = ecsMakeEntityId(i, 1), .mask = nocomponent, .archetype = NULL, .row = 0
+		};
+	}
+	
+	for(size_t i = 0; i < valueCount; i++)
+		values[i] = data[i] != NULL ? (const BYTE*)data[i] + created * sizes[i] : NULL;
+	size_t placed = ecsPlaceEntities(archetype, mask, first, fresh, &components, data != NULL ? values : NULL);
+	ecsEntities.size = first + placed;
+	
+	if(outIds)
+	{
+		for(size_t i = 0; i < placed; i++)
+			outIds[created + i] = ecsMakeEntityId(first + i, 1);
+	}
+	return created + placed;
+}
+
+size_t ecsCreateEntitiesDeferred(ecsComponentMask components, size_t count, ecsEntityId* outIds)
+{
+	if(count == 0) return 0;
+	
+	// slots past the end of the list can be handed out from any thread without touching it,
+	// as long as all of them still fit into an entity index
+	size_t reserved = atomic_load(&ecsEntities.reserved);
+	do
+	{
+		size_t used = ecsEntities.size + reserved;
+		if(used > ECS_ENTITY_INDEX_MASK || count > ECS_ENTITY_INDEX_MASK + 1 - used) return 0;
+	}
+	while(!atomic_compare_exchange_weak(&ecsEntities.reserved, &reserved, reserved + count));
+	size_t first = ecsEntities.size + reserved;
+	
+	for(size_t i = 0; i < count; i++)
+		outIds[i] = ecsMakeEntityId(first + i, 1);
+	
+	ecsPushTask((ecsTask){ .type=ECS_ENTITIES_CREATE, .entity=outIds[0], .count=count, .components={ .mask=components } });
+	return count;
+}
+
+void ecsTaskCreateEntities(ecsEntityId first, size_t count, ecsComponentMask components)
+{
+	// slots of entities that cannot be created are released by ecsReleaseReservedSlots
+	ecsComponentMask mask = ecsMaskAnd(components, ecsRegisteredComponents());
+	ECSarchetype* archetype = ecsGetArchetype(mask);
+	if(archetype == NULL) return;
+	
+	ecsPlaceEntities(archetype, mask, ecsEntityIndex(first), count, NULL, NULL);
+}
+
+ecsComponentMask ecsGetComponentMask(ecsEntityId entity)
+{
+	ECSentityData* data = ecsFindEntityData(entity);
+	return data != NULL ? data->mask : nocomponent;
+}
+
+int ecsValidEntity(ecsEntityId entity)
+{
+	return ecsFindEntityData(entity) != NULL;
+}
+
+void ecsDestroyEntity(ecsEntityId e)
+{ ecsPushTask((ecsTask){.type=ECS_ENTITY_DESTROY, .entity=e}); }
+void ecsTaskDestroyEntity(ecsEntityId e)
+{
+	ECSentityData* data = ecsFindEntityData(e);
+	if(data == NULL) return; // no such entity
+	
+	// destroy all components owned by entity
+	ecsArchetypeRemove(data->archetype, data->row);
+	
+	// bump the version so that remaining copies of the id become invalid
+	size_t index = ecsEntityIndex(e);
+	ecsEntityId version = ecsEntityVersion(e) + 1;
+	if(version > ECS_ENTITY_VERSION_MASK) version = 1;
+	
+	// push slot onto the free list
+	data->id = ecsMakeEntityId(index, version);
+	ecsIndexTags(index, data->mask, nocomponent);
+	data->mask = nocomponent;
+	data->archetype = NULL;
+	data->row = ecsEntities.freeList;
+	ecsEntities.freeList = index;
+}
+
+//
+// WORKERS
+//
+
+/**
+ * \brief Wakes threads waiting in ecsWaitForWork, called after pushing work or finishing the frame.
+ */
+static inline void ecsNotifyIdle()
+{
+	// waiters count themselves before checking posted, so one of both sides always sees the other
+	atomic_fetch_add(&ecsWorkers.posted, 1);
+	if(atomic_load(&ecsWorkers.sleeping) == 0) return;
+	
+	pthread_mutex_lock(&ecsWorkers.idleLock);
+	pthread_cond_broadcast(&ecsWorkers.idle);
+	pthread_mutex_unlock(&ecsWorkers.idleLock);
+}
+
+/**
+ * \brief Parks the calling thread until work is pushed or the frame ends.
+ * \param posted The value of ecsWorkers.posted before the thread last looked for work.
+ */
+static void ecsWaitForWork(size_t posted)
+{
+	pthread_mutex_lock(&ecsWorkers.idleLock);
+	atomic_fetch_add(&ecsWorkers.sleeping, 1);
+	while(atomic_load(&ecsWorkers.posted) == posted && atomic_load(&ecsWorkers.remaining) > 0)
+		pthread_cond_wait(&ecsWorkers.idle, &ecsWorkers.idleLock);
+	atomic_fetch_sub(&ecsWorkers.sleeping, 1);
+	pthread_mutex_unlock(&ecsWorkers.idleLock);
+}
+
+/**
+ * \brief Lets the calling thread run a range unless its job already runs on as many threads as it may.
+ * \returns 0 if the range has to wait for a thread to leave its job, see ecsLeaveJob.
+ */
+static inline int ecsEnterJob(ECSrange range)
+{
+	ECSjob* job = range.job;
+	if(range.begin == ECS_NO_SLOT || job->threadLimit == 0) return 1; // start requests and matching are not limited
+	
+	size_t active = atomic_load(&job->active);
+	do
+	{
+		if(active >= job->threadLimit) return 0;
+	}
+	while(!atomic_compare_exchange_weak(&job->active, &active, active + 1));
+	return 1;
+}
+
+static inline void ecsLeaveJob(ECSjob* job)
+{
+	// ranges held back by the limit can be taken now, wake threads that gave up on them
+	if(job->threadLimit > 0 && atomic_fetch_sub(&job->active, 1) == job->threadLimit)
+		ecsNotifyIdle();
+}
+
+static inline int ecsDequePush(ECSdeque* deque, ECSrange range)
+{
+	pthread_mutex_lock(&deque->lock);
+	
+	// move ranges to the front before growing
+	if(deque->tail == deque->capacity && deque->head > 0)
+	{
+		memmove(deque->begin, deque->begin + deque->head, (deque->tail - deque->head) * sizeof(ECSrange));
+		deque->tail -= deque->head;
+		deque->head = 0;
+	}
+	
+	ECSrange* nptr = ecsReserve(deque->begin, &deque->capacity, deque->tail + 1, sizeof(ECSrange));
+	if(nptr == NULL)
+	{
+		pthread_mutex_unlock(&deque->lock);
+		return 0;
+	}
+	deque->begin = nptr;
+	deque->begin[deque->tail++] = range;
+	
+	pthread_mutex_unlock(&deque->lock);
+	ecsNotifyIdle();
+	return 1;
+}
+
+/**
+ * \brief Takes the newest range, used by the owner of the deque.
+ */
+static inline int ecsDequePop(ECSdeque* deque, ECSrange* range)
+{
+	int found = 0;
+	pthread_mutex_lock(&deque->lock);
+	if(deque->tail > deque->head && ecsEnterJob(deque->begin[deque->tail - 1]))
+	{
+		*range = deque->begin[--deque->tail];
+		found = 1;
+	}
+	if(deque->tail == deque->head)
+		deque->head = deque->tail = 0;
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+/**
+ * \brief Takes the oldest range, used by other threads, which receive the largest pieces of work this way.
+ */
+static inline int ecsDequeSteal(ECSdeque* deque, ECSrange* range)
+{
+	int found = 0;
+	pthread_mutex_lock(&deque->lock);
+	if(deque->tail > deque->head && ecsEnterJob(deque->begin[deque->head]))
+	{
+		*range = deque->begin[deque->head++];
+		found = 1;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+/**
+ * \brief Sends tasks pushed by the calling thread to its command buffer until ecsEndCommands.
+ * \param system The system about to run.
+ * \param begin The first entity of the range it runs on, orders the tasks among those pushed by other ranges.
+ */
+static inline void ecsBeginCommands(size_t self, size_t system, size_t begin)
+{
+	ecsThreadCommands = ecsWorkers.commands + self;
+	ecsThreadSystem = system;
+	ecsThreadBegin = begin;
+	ecsThreadIndex = self;
+}
+
+static inline void ecsEndCommands()
+{
+	ecsThreadCommands = NULL;
+}
+
+/**
+ * \brief Runs a range, first splitting off upper halves onto the deque of self until it is no larger than the grain size.
+ * \note Splits fall on multiples of the grain size, so a job has exactly as many ranges as its entities need pieces of grain size.
+ * The calling thread has to have entered the job, see ecsEnterJob.
+ */
+static void ecsRunRange(size_t self, ECSrange range)
+{
+	ECSjob* job = range.job;
+	
+	while(range.end - range.begin > job->grain)
+	{
+		size_t pieces = (range.end - range.begin + job->grain - 1) / job->grain;
+		size_t mid = range.begin + pieces / 2 * job->grain;
+		if(!ecsDequePush(ecsWorkers.deques + self, (ECSrange){ .job = job, .begin = mid, .end = range.end }))
+			break; // run the remainder in one go
+		range.end = mid;
+	}
+	
+	ecsRunSystemArgs args = job->args;
+	args.begin = range.begin;
+	args.count = range.end - range.begin;
+	unsigned long long start = ecsTiming() ? ecsNow() : 0;
+	ecsBeginCommands(self, job->system, range.begin);
+	ecsRunSystem(&args);
+	ecsEndCommands();
+	if(ecsTiming())
+		ecsTimeRange(self, job->system, start, args.count);
+	ecsLeaveJob(job);
+	
+	// whoever processes the last entities finishes the system
+	if(atomic_fetch_sub(&job->remaining, args.count) == args.count)
+		ecsFinishSystem(self, job->system);
+}
+
+/**
+ * \brief Requests a system to be started by whichever thread gets to it first.
+ */
+static void ecsScheduleSystem(size_t self, size_t index)
+{
+	ECSsystem* system = ecsSystems.begin + index;
+	ECSrange request = { .job = &system->state->job, .begin = ECS_NO_SLOT, .end = ECS_NO_SLOT };
+	
+	// systems that did not declare their access only run on the thread calling ecsRunSystems
+	ECSdeque* deque = ecsMaskIsEmpty(ecsMaskOr(system->readMask, system->writeMask))
+		? &ecsWorkers.mainQueue
+		: ecsWorkers.deques + self;
+	
+	if(!ecsDequePush(deque, request))
+		ecsStartSystem(self, index); // out of memory, start it right here
+}
+
+/**
+ * \brief Runs ranges and starts systems until every system of the current frame has finished.
+ */
+static void ecsWorkOnFrame(size_t self)
+{
+	size_t participants = ecsWorkers.size + 1;
+	size_t misses = 0;
+	ECSrange range;
+	int found;
+	
+	while(atomic_load(&ecsWorkers.remaining) > 0)
+	{
+		size_t posted = atomic_load(&ecsWorkers.posted);
+		found = self == 0 && ecsDequeSteal(&ecsWorkers.mainQueue, &range);
+		if(!found)
+			found = ecsDequePop(ecsWorkers.deques + self, &range);
+		for(size_t i = 1; !found && i < participants; i++)
+			found = ecsDequeSteal(ecsWorkers.deques + (self + i) % participants, &range);
+		
+		// remaining work is being run elsewhere or waits for it, stop spinning if that takes a while
+		misses = found ? 0 : misses + 1;
+		if(misses >= ECS_IDLE_SPINS)
+		{
+			ecsWaitForWork(posted);
+			misses = 0;
+		}
+		else if(!found)
+			sched_yield();
+		else if(range.begin == ECS_NO_SLOT)
+			ecsStartSystem(self, range.job->system);
+		else if(range.job->matching)
+			ecsMatchRange(self, range);
+		else
+			ecsRunRange(self, range);
+	}
+}
+
+static void* ecsWorkerMain(void* args)
+{
+	ECSworkerStart* start = args;
+	size_t self = start->self;
+	size_t seen = 0;
+	
+	ecsCurrentWorld = start->world;
+	
+	pthread_mutex_lock(&ecsWorkers.lock);
+	for(;;)
+	{
+		// park until a new frame starts
+		while(ecsWorkers.generation == seen && !ecsWorkers.quit)
+			pthread_cond_wait(&ecsWorkers.wake, &ecsWorkers.lock);
+		if(ecsWorkers.quit) break;
+		
+		seen = ecsWorkers.generation;
+		ecsWorkers.busy++;
+		pthread_mutex_unlock(&ecsWorkers.lock);
+		
+		ecsWorkOnFrame(self);
+		
+		pthread_mutex_lock(&ecsWorkers.lock);
+		ecsWorkers.busy--;
+		if(ecsWorkers.busy == 0)
+			pthread_cond_broadcast(&ecsWorkers.done);
+	}
+	pthread_mutex_unlock(&ecsWorkers.lock);
+	return NULL;
+}
+
+static int ecsStartWorkers(size_t count)
+{
+	ecsWorkers.size = 0;
+	ecsWorkers.threads = NULL;
+	ecsWorkers.starts = NULL;
+	ecsWorkers.generation = 0;
+	ecsWorkers.busy = 0;
+	ecsWorkers.quit = 0;
+	atomic_init(&ecsWorkers.remaining, 0);
+	memset(&ecsWorkers.mainQueue, 0x0, sizeof(ECSdeque));
+	pthread_mutex_init(&ecsWorkers.mainQueue.lock, NULL);
+	pthread_mutex_init(&ecsWorkers.lock, NULL);
+	pthread_cond_init(&ecsWorkers.wake, NULL);
+	pthread_cond_init(&ecsWorkers.done, NULL);
+	ecsWorkers.parallel = 0;
+	atomic_init(&ecsWorkers.posted, 0);
+	atomic_init(&ecsWorkers.sleeping, 0);
+	pthread_mutex_init(&ecsWorkers.idleLock, NULL);
+	pthread_cond_init(&ecsWorkers.idle, NULL);
+	
+	// one deque per worker plus one for the thread calling ecsRunSystems
+	ecsWorkers.deques = ecsCalloc(count + 1, sizeof(ECSdeque));
+	ecsWorkers.commands = ecsCalloc(count + 1, sizeof(ECScommandBuffer));
+	if(ecsWorkers.deques != NULL)
+		pthread_mutex_init(&ecsWorkers.deques[0].lock, NULL); // destroyed by ecsStopWorkers even if starting fails
+	if(ecsWorkers.deques == NULL || ecsWorkers.commands == NULL) return 0;
+	
+	if(count == 0) return 1;
+	
+	ecsWorkers.threads = ecsMalloc(count * sizeof(pthread_t));
+	ecsWorkers.starts = ecsMalloc(count * sizeof(ECSworkerStart));
+	if(ecsWorkers.threads == NULL || ecsWorkers.starts == NULL) return 0;
+	
+	// a pool smaller than requested still works, the calling thread picks up the rest
+	for(size_t i = 0; i < count; i++)
+	{
+		pthread_mutex_init(&ecsWorkers.deques[i + 1].lock, NULL);
+		ecsWorkers.starts[i] = (ECSworkerStart){ .world = ecsCurrentWorld, .self = i + 1 };
+		if(pthread_create(ecsWorkers.threads + i, NULL, &ecsWorkerMain, ecsWorkers.starts + i) != 0)
+		{
+			pthread_mutex_destroy(&ecsWorkers.deques[i + 1].lock);
+			return 0;
+		}
+		ecsWorkers.size++;
+	}
+	return 1;
+}
+
+static void ecsStopWorkers()
+{
+	pthread_mutex_lock(&ecsWorkers.lock);
+	ecsWorkers.quit = 1;
+	pthread_cond_broadcast(&ecsWorkers.wake);
+	pthread_mutex_unlock(&ecsWorkers.lock);
+	
+	for(size_t i = 0; i < ecsWorkers.size; i++)
+		pthread_join(ecsWorkers.threads[i], NULL);
+	
+	if(ecsWorkers.deques)
+	{
+		for(size_t i = 0; i <= ecsWorkers.size; i++)
+		{
+			pthread_mutex_destroy(&ecsWorkers.deques[i].lock);
+			ecsFree(ecsWorkers.deques[i].begin);
+		}
+		ecsFree(ecsWorkers.deques);
+	}
+	if(ecsWorkers.commands)
+	{
+		for(size_t i = 0; i <= ecsWorkers.size; i++)
+		{
+			ecsFree(ecsWorkers.commands[i].tasks.begin);
+			ecsFree(ecsWorkers.commands[i].segments);
+		}
+		ecsFree(ecsWorkers.commands);
+	}
+	if(ecsWorkers.threads) ecsFree(ecsWorkers.threads);
+	if(ecsWorkers.starts) ecsFree(ecsWorkers.starts);
+	ecsWorkers.deques = NULL;
+	ecsWorkers.commands = NULL;
+	ecsWorkers.threads = NULL;
+	ecsWorkers.starts = NULL;
+	ecsWorkers.size = 0;
+	
+	pthread_mutex_destroy(&ecsWorkers.mainQueue.lock);
+	ecsFree(ecsWorkers.mainQueue.begin);
+	
+	pthread_cond_destroy(&ecsWorkers.done);
+	pthread_cond_destroy(&ecsWorkers.wake);
+	pthread_mutex_destroy(&ecsWorkers.lock);
+	pthread_cond_destroy(&ecsWorkers.idle);
+	pthread_mutex_destroy(&ecsWorkers.idleLock);
+}
+
+//
+// SYSTEMS
+//
+
+int matchQuery(ecsComponentQuery query, ecsComponentMask mask)
+{
+	if(query.comparison == ECS_QUERY_ANY)
+		return ecsMaskIntersects(mask, query.mask);
+	else if(query.comparison == ECS_QUERY_ALL)
+		return ecsMaskContains(mask, query.mask);
+	return 0;
+}
+
+/**
+ * \brief ecsMatchQueryDesc, inlined into the loops filtering rows.
+ */
+static inline int ecsMatchMask(const ecsQueryDesc* query, ecsComponentMask mask)
+{
+	// a single pass over the words of all masks, combined without branching
+	const unsigned long long* m = ecsMaskWords(&mask);
+	const unsigned long long* all = ecsMaskWords(&query->all);
+	const unsigned long long* any = ecsMaskWords(&query->any);
+	const unsigned long long* none = ecsMaskWords(&query->none);
+	unsigned long long rejected = 0, anyFound = 0, anyWanted = 0;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++)
+	{
+		rejected |= (all[i] & ~m[i]) | (none[i] & m[i]);
+		anyFound |= any[i] & m[i];
+		anyWanted |= any[i];
+	}
+	return (rejected == 0) & ((anyFound != 0) | (anyWanted == 0));
+}
+
+int ecsMatchQueryDesc(const ecsQueryDesc* query, ecsComponentMask mask)
+{
+	return ecsMatchMask(query, mask);
+}
+
+void* ecsRunSystem(void* args)
+{
+	ecsRunSystemArgs* arg = args;
+	ECSchunkView* view = arg->views;
+	size_t begin = arg->begin;
+	size_t remaining = arg->count;
+	
+	// skip views entirely before this slice
+	while(begin >= view->count && remaining > 0)
+	{
+		begin -= view->count;
+		view++;
+	}
+	
+	const ECSsystem* system = arg->system;
+	void* columns[ECS_MAX_SYSTEM_COLUMNS];
+	
+	// call the system once for each chunk the slice overlaps
+	while(remaining > 0)
+	{
+		size_t count = view->count - begin;
+		count = count > remaining ? remaining : count;
+		begin += view->first;
+		
+		// components the system declared to write count as changed
+		for(size_t i = 0; i < view->archetype->columnCount; i++)
+		{
+			if(ecsMaskTest(&system->writeMask, view->archetype->columns[i].type))
+				ecsRaiseTick(view->ticks + i, system->state->changeTick);
+		}
+		if(system->columnFn != NULL)
+		{
+			// columns start at fixed offsets from the entity ids at the start of the chunk
+			BYTE* data = (BYTE*)view->entities;
+			for(size_t i = 0; i < system->columnCount; i++)
+			{
+				size_t type = system->columnTypes[i];
+				int column = type != ECS_NO_SLOT ? view->archetype->columnOf[type] : -1;
+				columns[i] = column < 0 ? NULL
+					: data + view->archetype->columns[column].offset + begin * system->strides[i];
+			}
+			system->columnFn(view->entities + begin, columns, system->strides, count, arg->deltaTime);
+		}
+		else
+			arg->fn(view->entities + begin, view->components + begin, count, arg->deltaTime);
+		remaining -= count;
+		begin = 0;
+		view++;
+	}
+	return NULL;
+}
+
+static inline int ecsQueryHasTags(const ecsQueryDesc* query)
+{
+	return ecsMaskIntersects(ecsMaskOr(ecsMaskOr(query->all, query->any), query->none), ecsComponents.tags);
+}
+
+/**
+ * \brief Checks if rows of an archetype with mask may match query.
+ * \note Tags are not part of archetype masks, queries involving tags are checked again per row.
+ */
+static inline int ecsMatchArchetype(const ecsQueryDesc* query, ecsComponentMask mask)
+{
+	ecsQueryDesc untagged = {
+		.all = ecsMaskAndNot(query->all, ecsComponents.tags),
+		.any = ecsMaskIntersects(query->any, ecsComponents.tags) ? nocomponent : query->any,
+		.none = ecsMaskAndNot(query->none, ecsComponents.tags)
+	};
+	return ecsMatchQueryDesc(&untagged, mask);
+}
+
+/**
+ * \brief Sets bit i of bits for every mask i of count masks that matches query, and clears the others.
+ * \note Writes (count + 63) / 64 words.
+ */
+static void ecsMatchRows(const ecsQueryDesc* query, const ecsComponentMask* masks, size_t count, uint64_t* bits)
+{
+#if defined(__AVX2__) && ECS_COMPONENT_BITS == 64
+	const __m256i all = _mm256_set1_epi64x((long long)query->all);
+	const __m256i any = _mm256_set1_epi64x((long long)query->any);
+	const __m256i none = _mm256_set1_epi64x((long long)query->none);
+	const __m256i zero = _mm256_setzero_si256();
+#endif
+	size_t row = 0;
+	for(size_t word = 0; word * 64 < count; word++)
+	{
+		uint64_t matched = 0;
+		size_t end = count - word * 64 < 64 ? count : word * 64 + 64;
+#if defined(__AVX2__) && ECS_COMPONENT_BITS == 64
+		// four masks at a time, the same test as ecsMatchMask
+		for(; row + 4 <= end; row += 4)
+		{
+			__m256i m = _mm256_loadu_si256((const __m256i*)(masks + row));
+			__m256i rejected = _mm256_or_si256(_mm256_andnot_si256(m, all), _mm256_and_si256(none, m));
+			__m256i accepted = _mm256_cmpeq_epi64(rejected, zero);
+			if(query->any != 0)
+				accepted = _mm256_andnot_si256(_mm256_cmpeq_epi64(_mm256_and_si256(any, m), zero), accepted);
+			matched |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(accepted)) << (row % 64);
+		}
+#endif
+		for(; row < end; row++)
+			matched |= (uint64_t)ecsMatchMask(query, masks[row]) << (row % 64);
+		bits[word] = matched;
+	}
+}
+
+/**
+ * \brief Adds a view for each run of set bits of the rows of chunk, as written by ecsMatchRows.
+ * \returns The number of rows added, views->size only counts the views added so far if out of memory.
+ */
+static size_t ecsAppendRuns(ECSviewList* views, const ECSchunkView* chunk, const uint64_t* bits)
+{
+	size_t words = (chunk->count + 63) / 64;
+	size_t total = 0;
+	size_t first = 0;
+	size_t row;
+	int inRun = 0;
+	uint64_t carry = 0;
+	uint64_t edges;
+	for(size_t w = 0; w <= words; w++)
+	{
+		// bits that differ from the bit before them alternately start and end a run, rows past count are clear
+		uint64_t word = w < words ? bits[w] : 0;
+		edges = word ^ ((word << 1) | carry);
+		carry = word >> 63;
+		for(; edges != 0; edges &= edges - 1)
+		{
+			row = w * 64 + (size_t)__builtin_ctzll(edges);
+			inRun = !inRun;
+			if(inRun)
+			{
+				first = row;
+				continue;
+			}
+			
+			if(!ecsResizeViews(views, views->size + 1))
+				return total;
+			views->begin[views->size++] = (ECSchunkView) {
+				.entities = chunk->entities, .components = chunk->components, .ticks = chunk->ticks,
+				.first = first, .count = row - first, .archetype = chunk->archetype
+			};
+			total += row - first;
+		}
+	}
+	return total;
+}
+
+/**
+ * \brief Collects the runs of rows in a chunk whose masks match query.
+ * \returns The number of rows collected.
+ */
+static size_t ecsGatherMatchingRows(ECSviewList* views, ECSarchetype* archetype, ECSchunk* chunk, const ecsQueryDesc* query)
+{
+	ECSchunkView view = {
+		.entities = (ecsEntityId*)chunk->data, .components = ecsChunkMasks(archetype, chunk), .ticks = ecsChunkTicks(archetype, chunk),
+		.first = 0, .count = chunk->count, .archetype = archetype
+	};
+#if defined(__AVX2__) && ECS_COMPONENT_BITS == 64
+	// vectorized matching pays off through a bitmap of the rows
+	uint64_t bits[(ECS_MAX_CHUNK_ROWS + 63) / 64];
+	ecsMatchRows(query, view.components, view.count, bits);
+	return ecsAppendRuns(views, &view, bits);
+#else
+	// one mask at a time, finding runs while matching is faster than going through a bitmap
+	size_t total = 0;
+	size_t first;
+	for(size_t row = 0; row < view.count; row++)
+	{
+		if(!ecsMatchMask(query, view.components[row]))
+			continue;
+		
+		first = row;
+		while(row < view.count && ecsMatchMask(query, view.components[row]))
+			row++;
+		
+		if(!ecsResizeViews(views, views->size + 1))
+			return total;
+		views->begin[views->size++] = view;
+		views->begin[views->size - 1].first = first;
+		views->begin[views->size - 1].count = row - first;
+		total += row - first;
+	}
+	return total;
+#endif
+}
+
+/**
+ * \brief Checks if any column of a chunk holding a component in mask changed after tick since.
+ */
+static inline int ecsChunkChanged(ECSarchetype* archetype, ECSchunk* chunk, const ecsComponentMask* mask, size_t since)
+{
+	atomic_size_t* ticks = ecsChunkTicks(archetype, chunk);
+	for(size_t i = 0; i < archetype->columnCount; i++)
+	{
+		if(ecsMaskTest(mask, archetype->columns[i].type) && atomic_load_explicit(ticks + i, memory_order_relaxed) > since)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * \brief The smallest slot set of the tags every entity matching query must carry.
+ * \returns NULL if the query requires no tag or the index of one of them is incomplete.
+ */
+static ECSslotSet* ecsSmallestTagSet(const ecsQueryDesc* query)
+{
+	ecsComponentMask tags = ecsMaskAnd(query->all, ecsComponents.tags);
+	ECSslotSet* smallest = NULL;
+	for(size_t i = ecsMaskNext(&tags, 0); i < ECS_MAX_COMPONENTS; i = ecsMaskNext(&tags, i + 1))
+	{
+		ECSslotSet* set = &ecsComponents.begin[i].slots;
+		if(set->incomplete) return NULL;
+		if(smallest == NULL || set->count < smallest->count)
+			smallest = set;
+	}
+	return smallest;
+}
+
+/**
+ * \brief Collects the rows of entities matching the query of system by intersecting the slot sets of its tags.
+ * \note Entities are visited in slot order, rows next to each other in a chunk are merged into one view.
+ * \returns The number of rows collected.
+ */
+static size_t ecsGatherTaggedRows(ECSsystem* system, size_t since)
+{
+	ECSviewList* views = &system->state->views;
+	ecsComponentMask tags = ecsMaskAnd(system->query.all, ecsComponents.tags);
+	int filterChanges = !ecsMaskIsEmpty(system->changedMask);
+	size_t total = 0;
+	
+	// only words below the end of every set can have a slot in all of them
+	size_t wordCount = ecsEntities.size / 64 + 1;
+	for(size_t i = ecsMaskNext(&tags, 0); i < ECS_MAX_COMPONENTS; i = ecsMaskNext(&tags, i + 1))
+	{
+		if(ecsComponents.begin[i].slots.wordCapacity < wordCount)
+			wordCount = ecsComponents.begin[i].slots.wordCapacity;
+	}
+	
+	ECSentityData* entity;
+	ECSarchetype* archetype;
+	ECSchunk* chunk;
+	ECSchunkView* last = NULL;
+	uint64_t summary, bits;
+	for(size_t s = 0; s * 64 < wordCount; s++)
+	{
+		summary = ~0ull;
+		for(size_t i = ecsMaskNext(&tags, 0); i < ECS_MAX_COMPONENTS && summary != 0; i = ecsMaskNext(&tags, i + 1))
+			summary &= ecsComponents.begin[i].slots.summary[s];
+		
+		for(; summary != 0; summary &= summary - 1)
+		{
+			size_t word = s * 64 + (size_t)__builtin_ctzll(summary);
+			bits = ~0ull;
+			for(size_t i = ecsMaskNext(&tags, 0); i < ECS_MAX_COMPONENTS && bits != 0; i = ecsMaskNext(&tags, i + 1))
+				bits &= ecsComponents.begin[i].slots.words[word];
+			
+			for(; bits != 0; bits &= bits - 1)
+			{
+				entity = ecsEntities.begin + word * 64 + (size_t)__builtin_ctzll(bits);
+				if(!ecsMatchQueryDesc(&system->query, entity->mask))
+					continue;
+				
+				archetype = entity->archetype;
+				chunk = archetype->chunks + entity->row / archetype->chunkCapacity;
+				size_t row = entity->row % archetype->chunkCapacity;
+				if(filterChanges && !ecsChunkChanged(archetype, chunk, &system->changedMask, since))
+					continue;
+				
+				total++;
+				if(last != NULL && last->entities == (ecsEntityId*)chunk->data && last->first + last->count == row)
+				{
+					last->count++;
+					continue;
+				}
+				
+				if(!ecsResizeViews(views, views->size + 1))
+					return total - 1; // out of memory, run on the rows found so far
+				last = views->begin + views->size++;
+				*last = (ECSchunkView) {
+					.entities = (ecsEntityId*)chunk->data, .components = ecsChunkMasks(archetype, chunk), .ticks = ecsChunkTicks(archetype, chunk),
+					.first = row, .count = 1, .archetype = archetype
+				};
+			}
+		}
+	}
+	return total;
+}
+
+/**
+ * \brief Collects the chunks whose rows ecsMatchRange filters, and makes room for their row bits.
+ * \returns 0 if out of memory.
+ */
+static int ecsGatherCandidates(ECSsystem* system, size_t since)
+{
+	ECSsystemState* state = system->state;
+	ECSviewList* candidates = &state->candidates;
+	int filterChanges = !ecsMaskIsEmpty(system->changedMask);
+	size_t words = 0;
+	
+	candidates->size = 0;
+	for(size_t i = 0; i < state->matchCount; ++i)
+	{
+		ECSarchetype* archetype = state->matches[i];
+		for(size_t j = 0; j < archetype->chunkCount && archetype->chunks[j].count > 0; ++j)
+		{
+			ECSchunk* chunk = archetype->chunks + j;
+			if(filterChanges && !ecsChunkChanged(archetype, chunk, &system->changedMask, since))
+				continue;
+			
+			size_t* nptr = ecsReserve(state->candidateWords, &state->candidateCapacity, candidates->size + 1, sizeof(size_t));
+			if(nptr == NULL || !ecsResizeViews(candidates, candidates->size + 1)) return 0;
+			state->candidateWords = nptr;
+			
+			// every candidate starts at a new word, so threads never write to the same word
+			state->candidateWords[candidates->size] = words;
+			words += (chunk->count + 63) / 64;
+			candidates->begin[candidates->size++] = (ECSchunkView) {
+				.entities = (ecsEntityId*)chunk->data, .components = ecsChunkMasks(archetype, chunk), .ticks = ecsChunkTicks(archetype, chunk),
+				.first = 0, .count = chunk->count, .archetype = archetype
+			};
+		}
+	}
+	
+	uint64_t* bits = ecsReserve(state->rowBits, &state->rowWordCapacity, words, sizeof(uint64_t));
+	if(bits == NULL && words > 0) return 0;
+	state->rowBits = bits;
+	return 1;
+}
+
+/**
+ * \brief Collects the chunks of all archetypes matching the query of system.
+ * \param since The change tick of the previous run of system, chunks without later changes are skipped if system asks for it.
+ * \returns The number of entities in the collected chunks,
+ * ECS_NO_SLOT if their rows have to be matched by ecsMatchRange first, the chunks are in state->candidates then.
+ */
+static size_t ecsGatherViews(ECSsystem* system, size_t since)
+{
+	ECSviewList* views = &system->state->views;
+	ECSarchetype* archetype;
+	ECSchunk* chunk;
+	size_t total = 0;
+	
+	// archetypes do not know about tags, so queries involving tags look at every row
+	int filterRows = ecsQueryHasTags(&system->query);
+	int filterChanges = !ecsMaskIsEmpty(system->changedMask);
+	
+	views->size = 0;
+	
+	size_t rows = 0;
+	for(size_t i = 0; filterRows && i < system->state->matchCount; ++i)
+		rows += system->state->matches[i]->count;
+	
+	// when few entities carry a required tag, visiting them beats looking at every row of the matching archetypes
+	ECSslotSet* tagged = filterRows ? ecsSmallestTagSet(&system->query) : NULL;
+	if(tagged != NULL && tagged->count * ECS_SPARSE_TAG_RATIO < rows)
+		return ecsGatherTaggedRows(system, since);
+	
+	// otherwise split looking at every row between threads, unless the system is bound to the calling thread
+	int parallel = ecsWorkers.size > 0 && !ecsMaskIsEmpty(ecsMaskOr(system->readMask, system->writeMask));
+	if(filterRows && parallel && rows >= ECS_PARALLEL_MATCH_ROWS && ecsGatherCandidates(system, since))
+		return ECS_NO_SLOT;
+	
+	for(size_t i = 0; i < system->state->matchCount; ++i)
+	{
+		archetype = system->state->matches[i];
+		if(archetype->count == 0)
+			continue;
+		
+		size_t viewCount = views->size;
+		if(!filterRows && !ecsResizeViews(views, viewCount + archetype->chunkCount))
+			break; // out of memory, run on the chunks found so far
+		
+		for(size_t j = 0; j < archetype->chunkCount && archetype->chunks[j].count > 0; ++j)
+		{
+			chunk = archetype->chunks + j;
+			if(filterChanges && !ecsChunkChanged(archetype, chunk, &system->changedMask, since))
+				continue;
+			
+			if(filterRows)
+			{
+				total += ecsGatherMatchingRows(views, archetype, chunk, &system->query);
+				continue;
+			}
+			
+			views->begin[viewCount++] = (ECSchunkView) {
+				.entities = (ecsEntityId*)chunk->data,
+				.components = ecsChunkMasks(archetype, chunk),
+				.ticks = ecsChunkTicks(archetype, chunk),
+				.first = 0,
+				.count = chunk->count,
+				.archetype = archetype
+			};
+			total += chunk->count;
+		}
+		if(!filterRows)
+			views->size = viewCount;
+	}
+	return total;
+}
+
+/**
+ * \brief Tests archetypes created since the last frame against the query of every system.
+ * \note Archetypes are never destroyed, so a system only ever has to look at each one once.
+ */
+static void ecsUpdateQueryCaches()
+{
+	ECSsystemState* state;
+	ECSarchetype* archetype;
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		state = ecsSystems.begin[i].state;
+		if(!ecsSystems.begin[i].hasQuery)
+			continue;
+		
+		for(; state->archetypesSeen < ecsArchetypes.size; state->archetypesSeen++)
+		{
+			archetype = ecsArchetypes.begin[state->archetypesSeen];
+			if(!ecsMatchArchetype(&ecsSystems.begin[i].query, archetype->mask))
+				continue;
+			
+			ECSarchetype** nptr = ecsReserve(state->matches, &state->matchCapacity, state->matchCount + 1, sizeof(ECSarchetype*));
+			if(nptr == NULL) break; // out of memory, try again next frame
+			state->matches = nptr;
+			state->matches[state->matchCount++] = archetype;
+		}
+	}
+}
+
+static void ecsStartSystem(size_t self, size_t index)
+{
+	ECSsystem* system = ecsSystems.begin + index;
+	
+	// changes the system makes from now on are new to everyone who ran before
+	size_t lastRun = system->state->changeTick;
+	system->state->changeTick = atomic_fetch_add(&ecsChangeTick, 1) + 1;
+	
+	if(ecsTiming())
+		system->state->startTime = ecsNow();
+	
+	size_t total = 0;
+	if(system->hasQuery)
+		total = ecsGatherViews(system, lastRun);
+	
+	if(total == ECS_NO_SLOT)
+	{
+		// whoever matches the last candidate launches the system, see ecsMatchRange
+		ECSjob* match = &system->state->matchJob;
+		size_t count = system->state->candidates.size;
+		size_t pieces = (ecsWorkers.size + 1) * ECS_RANGES_PER_THREAD;
+		match->matching = 1;
+		match->grain = (count + pieces - 1) / pieces;
+		atomic_store(&match->remaining, count);
+		ecsMatchRange(self, (ECSrange){ .job = match, .begin = 0, .end = count });
+		return;
+	}
+	ecsLaunchSystem(self, index, total);
+}
+
+/**
+ * \brief Runs a system on the total entities in its views, splitting them into ranges for other threads.
+ */
+static void ecsLaunchSystem(size_t self, size_t index, size_t total)
+{
+	ECSsystem* system = ecsSystems.begin + index;
+	ECSjob* job = &system->state->job;
+	float deltaTime = ecsWorkers.deltaTime;
+	
+	if(ecsTiming())
+	{
+		system->state->gatherTime = ecsNow() - system->state->startTime;
+		system->state->entityCount = total;
+	}
+	
+	// ECS_NOQUERY systems and systems without matching entities get run exactly once
+	// with entity and components arguments on NULL
+	// and count argument on 0
+	if(total == 0)
+	{
+		unsigned long long start = ecsTiming() ? ecsNow() : 0;
+		ecsBeginCommands(self, index, 0);
+		if(system->columnFn != NULL)
+			system->columnFn(NULL, NULL, system->strides, 0, deltaTime);
+		else
+			system->fn(NULL, NULL, 0, deltaTime);
+		ecsEndCommands();
+		if(ecsTiming())
+			ecsTimeRange(self, index, start, 0);
+		ecsFinishSystem(self, index);
+		return;
+	}
+	
+	size_t threadCount = system->maxThreads > 0 ? system->maxThreads : 1;
+	
+	// maxThreads limits how many threads run ranges at once, not how many ranges there are,
+	// so that threads done with cheap ranges can take over the rest of expensive ones
+	size_t grain = system->grainSize;
+	if(grain == 0)
+		grain = total / ((ecsWorkers.size + 1) * ECS_RANGES_PER_THREAD);
+	if(threadCount == 1 || grain > total)
+		grain = total; // no other thread may help
+	if(grain == 0)
+		grain = 1;
+	
+	job->args = (ecsRunSystemArgs) {
+		.fn = system->fn, .system = system, .views = system->state->views.begin, .begin = 0, .count = total, .deltaTime = deltaTime
+	};
+	job->grain = grain;
+	job->threadLimit = threadCount;
+	atomic_store(&job->remaining, total);
+	atomic_store(&job->active, 1); // the calling thread
+	
+	// split off ranges for other threads to steal while running the first one here
+	ecsRunRange(self, (ECSrange){ .job = job, .begin = 0, .end = total });
+}
+
+/**
+ * \brief Matches the rows of a range of candidate chunks of a system, splitting off upper halves like ecsRunRange.
+ * \note The thread matching the last candidate collects the matching rows into views and launches the system.
+ */
+static void ecsMatchRange(size_t self, ECSrange range)
+{
+	ECSjob* job = range.job;
+	
+	while(range.end - range.begin > job->grain)
+	{
+		size_t mid = range.begin + (range.end - range.begin) / 2;
+		if(!ecsDequePush(ecsWorkers.deques + self, (ECSrange){ .job = job, .begin = mid, .end = range.end }))
+			break; // match the remainder in one go
+		range.end = mid;
+	}
+	
+	ECSsystem* system = ecsSystems.begin + job->system;
+	ECSsystemState* state = system->state;
+	for(size_t i = range.begin; i < range.end; i++)
+	{
+		ECSchunkView* candidate = state->candidates.begin + i;
+		ecsMatchRows(&system->query, candidate->components, candidate->count, state->rowBits + state->candidateWords[i]);
+	}
+	
+	size_t count = range.end - range.begin;
+	if(atomic_fetch_sub(&job->remaining, count) != count)
+		return;
+	
+	// the bits of every candidate are in, turn them into views in candidate order
+	size_t total = 0;
+	state->views.size = 0;
+	for(size_t i = 0; i < state->candidates.size; i++)
+		total += ecsAppendRuns(&state->views, state->candidates.begin + i, state->rowBits + state->candidateWords[i]);
+	ecsLaunchSystem(self, job->system, total);
+}
+
+static void ecsFinishSystem(size_t self, size_t index)
+{
+	ECSsystemState* state = ecsSystems.begin[index].state;
+	
+	if(ecsTiming())
+	{
+		state->finishTime = ecsNow();
+		ecsTrace(self, ecsSystems.begin[index].name, ECS_TRACE_SYSTEM_TRACK + index,
+			state->startTime, state->finishTime - state->startTime, state->entityCount);
+	}
+	
+	// start systems that were only waiting for this one
+	for(size_t i = 0; i < state->dependentCount; i++)
+	{
+		size_t dependent = state->dependents[i];
+		if(atomic_fetch_sub(&ecsSystems.begin[dependent].state->pending, 1) == 1)
+			ecsScheduleSystem(self, dependent);
+	}
+	
+	if(atomic_fetch_sub(&ecsWorkers.remaining, 1) == 1)
+		ecsNotifyIdle(); // let waiting threads leave the frame
+}
+
+static inline int ecsSystemsConflict(ECSsystem* a, ECSsystem* b)
+{
+	// systems that did not declare their access might touch anything
+	if(ecsMaskIsEmpty(ecsMaskOr(a->readMask, a->writeMask))) return 1;
+	if(ecsMaskIsEmpty(ecsMaskOr(b->readMask, b->writeMask))) return 1;
+	
+	return ecsMaskIntersects(a->writeMask, ecsMaskOr(b->readMask, b->writeMask))
+		|| ecsMaskIntersects(b->writeMask, a->readMask);
+}
+
+/**
+ * \brief Makes every system depend on each system before it in execution order that it conflicts with.
+ * Also decides whether frames are worth waking the workers for.
+ * \returns 0 if out of memory, the graph then has no edges and stays dirty, see ecsRunSystemsInOrder.
+ */
+static int ecsBuildSystemGraph()
+{
+	ECSsystemState* state;
+	ecsSortSystems();
+	
+	// workers help with ranges split off any system allowed more than one thread,
+	// and with starting or matching systems that declared their access
+	size_t shared = 0;
+	int splittable = 0;
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		ECSsystem* system = ecsSystems.begin + i;
+		splittable |= system->hasQuery && system->maxThreads > 1;
+		if(ecsMaskIsEmpty(ecsMaskOr(system->readMask, system->writeMask))) continue;
+		
+		shared++;
+		splittable |= system->hasQuery && ecsQueryHasTags(&system->query);
+	}
+	ecsWorkers.parallel = ecsWorkers.size > 0 && (splittable || shared > 1);
+	
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		ecsSystems.begin[i].state->job.system = i; // indices change as systems get sorted in and out
+		ecsSystems.begin[i].state->matchJob.system = i;
+		ecsSystems.begin[i].state->dependentCount = 0;
+		ecsSystems.begin[i].state->dependencyCount = 0;
+	}
+	
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		for(size_t j = 0; j < i; j++)
+		{
+			if(!ecsSystemsConflict(ecsSystems.begin + j, ecsSystems.begin + i))
+				continue;
+			
+			state = ecsSystems.begin[j].state;
+			size_t* nptr = ecsReserve(state->dependents, &state->dependentCapacity, state->dependentCount + 1, sizeof(size_t));
+			if(nptr == NULL)
+			{
+				for(size_t k = 0; k < ecsSystems.size; k++)
+				{
+					ecsSystems.begin[k].state->dependentCount = 0;
+					ecsSystems.begin[k].state->dependencyCount = 0;
+				}
+				ecsWorkers.parallel = 0;
+				return 0;
+			}
+			state->dependents = nptr;
+			state->dependents[state->dependentCount++] = i;
+			ecsSystems.begin[i].state->dependencyCount++;
+		}
+	}
+	ecsSystemGraphDirty = 0;
+	return 1;
+}
+
+/**
+ * \brief Runs every system on the calling thread in execution order, one after another.
+ * \note Used for frames the system graph could not be built for.
+ */
+static void ecsRunSystemsInOrder()
+{
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		atomic_store(&ecsWorkers.remaining, 1);
+		ecsStartSystem(0, i);
+		ecsWorkOnFrame(0); // ranges the system split off
+	}
+}
+
+void ecsRunSystems(float deltaTime)
+{
+	if(ecsProfiler.capacity > 0)
+		ecsBeginProfiledFrame();
+	
+	// without a graph, systems still run in order
+	int ordered = ecsSystemGraphDirty && !ecsBuildSystemGraph();
+	ecsUpdateQueryCaches();
+	
+	if(ecsSystems.size > 0)
+	{
+		pthread_mutex_lock(&ecsWorkers.lock);
+		// workers that woke up late for the previous frame may still be looking at it
+		while(ecsWorkers.busy > 0)
+			pthread_cond_wait(&ecsWorkers.done, &ecsWorkers.lock);
+		
+		ecsWorkers.deltaTime = deltaTime;
+		if(ordered)
+		{
+			pthread_mutex_unlock(&ecsWorkers.lock);
+			ecsRunSystemsInOrder();
+		}
+		else
+		{
+			atomic_store(&ecsWorkers.remaining, ecsSystems.size);
+			for(size_t i = 0; i < ecsSystems.size; i++)
+				atomic_store(&ecsSystems.begin[i].state->pending, ecsSystems.begin[i].state->dependencyCount);
+			
+			// systems that do not wait for others can start right away, the rest follow as their dependencies finish
+			for(size_t i = 0; i < ecsSystems.size; i++)
+			{
+				if(ecsSystems.begin[i].state->dependencyCount == 0)
+					ecsScheduleSystem(0, i);
+			}
+			
+			// frames the calling thread runs alone leave the workers parked
+			if(ecsWorkers.parallel)
+			{
+				ecsWorkers.generation++;
+				pthread_cond_broadcast(&ecsWorkers.wake);
+			}
+			pthread_mutex_unlock(&ecsWorkers.lock);
+			
+			ecsWorkOnFrame(0);
+		}
+	}
+	
+	ecsRunTasks();
+	
+	if(ecsProfiler.capacity > 0)
+		ecsEndProfiledFrame();
+}
+
+void ecsSortSystems()
+{
+	int swaps;
+	ECSsystem tmp;
+	
+	do
+	{
+		swaps = 0;
+		for(int i = 1; i < ecsSystems.size; ++i)
+		{
+			if(ecsSystems.begin[i-1].execOrder > ecsSystems.begin[i].execOrder)
+			{
+				memcpy(&tmp, &ecsSystems.begin[i-1], sizeof(ECSsystem));
+				memcpy(&ecsSystems.begin[i-1], &ecsSystems.begin[i], sizeof(ECSsystem));
+				memcpy(&ecsSystems.begin[i], &tmp, sizeof(ECSsystem));
+				swaps++;
+			}
+		}
+	}
+	while(swaps > 0);
+}
+
+void ecsEnableSystem(ecsSystemFn fn, ecsComponentMask query, ecsQueryComparison comp, int maxThreads, int execOrder)
+{
+	ecsEnableSystemEx(&(ecsSystemDesc)
+	{
+		.fn = fn,
+		.components = query,
+		.comparison = comp,
+		.maxThreads = maxThreads,
+		.executionOrder = execOrder
+	});
+}
+
+void ecsEnableSystemEx(const ecsSystemDesc* desc)
+{
+	// like matchQuery, any of no components is never present, requiring and rejecting everything matches nothing
+	int unmatchable = desc->comparison == ECS_QUERY_ANY && ecsMaskIsEmpty(ecsMaskOr(desc->components, desc->anyComponents));
+	
+	ECSsystem system =
+	{
+		.fn = desc->fn,
+		.columnFn = desc->columnFn,
+		.name = desc->name,
+		.maxThreads = desc->maxThreads,
+		.execOrder = desc->executionOrder,
+		.grainSize = desc->grainSize,
+		.readMask = desc->readComponents,
+		.writeMask = desc->writeComponents,
+		.changedMask = desc->changedComponents,
+		.hasQuery = desc->comparison != ECS_NOQUERY,
+		.query=(ecsQueryDesc)
+		{
+			.all = unmatchable ? anycomponent : desc->comparison == ECS_QUERY_ALL ? desc->components : nocomponent,
+			.any = desc->comparison == ECS_QUERY_ANY ? ecsMaskOr(desc->components, desc->anyComponents) : desc->anyComponents,
+			.none = unmatchable ? anycomponent : desc->noneComponents
+		}
+	};
+	
+	// resolve column components now, the list of component types does not change while systems run
+	while(system.columnCount < ECS_MAX_SYSTEM_COLUMNS && !ecsMaskIsEmpty(desc->columns[system.columnCount]))
+		system.columnCount++;
+	if(system.columnFn != NULL)
+	{
+		system.columnTypes = ecsMalloc(2 * ECS_MAX_SYSTEM_COLUMNS * sizeof(size_t));
+		if(system.columnTypes == NULL) return;
+		system.strides = system.columnTypes + ECS_MAX_SYSTEM_COLUMNS;
+		
+		ECScomponentType* ctype;
+		for(size_t i = 0; i < system.columnCount; i++)
+		{
+			ctype = ecsFindComponentType(desc->columns[i]);
+			system.columnTypes[i] = ctype != NULL ? (size_t)(ctype - ecsComponents.begin) : ECS_NO_SLOT;
+			system.strides[i] = ctype != NULL ? ctype->componentSize : 0;
+		}
+	}
+	
+	ecsPushTask((ecsTask){ .type=ECS_SYSTEM_CREATE, .system=system });
+}
+
+void ecsTaskEnableSystem(ECSsystem system)
+{
+	system.state = ecsCalloc(1, sizeof(ECSsystemState));
+	if(system.state != NULL && ecsResizeSystems(ecsSystems.size + 1))
+	{
+		ECSsystem* last = (ecsSystems.begin + ecsSystems.size - 1);
+		memcpy(last, &system, sizeof(ECSsystem));
+		ecsSystemGraphDirty = 1; // sorted into place once all tasks ran, see ecsBuildSystemGraph
+	}
+	else
+		ecsFreeSystem(&system);
+}
+
+void ecsDisableSystem(ecsSystemFn fn)
+{ ecsPushTask((ecsTask){ .type=ECS_SYSTEM_DESTROY, .system=(ECSsystem){ .fn=fn } }); }
+void ecsDisableColumnSystem(ecsColumnSystemFn fn)
+{ ecsPushTask((ecsTask){ .type=ECS_SYSTEM_DESTROY, .system=(ECSsystem){ .columnFn=fn } }); }
+void ecsTaskDisableSystem(ECSsystem system)
+{
+	// calculate distance between end and to replace
+	ECSsystem* to_replace = ecsFindSystem(system.fn, system.columnFn);
+	if(to_replace == NULL) return; // no such system
+	ecsFreeSystem(to_replace);
+	ECSsystem* end = ecsSystems.begin + ecsSystems.size;
+	size_t dist = (end - to_replace) - 1;
+
+	// shift everything after to-be-deleted item back by one (overwriting to-be-deleted)
+	memmove(to_replace, to_replace + 1, dist * sizeof(ECSsystem));
+
+	// resize array
+	ecsResizeSystems(ecsSystems.size - 1);
+	ecsSystemGraphDirty = 1;
+}
+
+static void ecsFreeSystem(ECSsystem* system)
+{
+	if(system->columnTypes) ecsFree(system->columnTypes);
+	
+	ECSsystemState* state = system->state;
+	if(state == NULL) return;
+	if(state->views.begin)	ecsFree(state->views.begin);
+	if(state->candidates.begin)	ecsFree(state->candidates.begin);
+	if(state->rowBits)		ecsFree(state->rowBits);
+	if(state->candidateWords)	ecsFree(state->candidateWords);
+	if(state->matches)		ecsFree(state->matches);
+	if(state->dependents)	ecsFree(state->dependents);
+	ecsFree(state);
+}
+
+//
+// TASKS
+//
+
+void ecsPushTask(ecsTask task)
+{
+	if(ecsThreadCommands != NULL)
+	{
+		ecsPushCommand(ecsThreadCommands, task);
+		return;
+	}
+	
+	if(ecsPushTaskStack())
+	{
+		ecsTask* last = ecsTasks.begin + ecsTasks.size - 1;
+		memmove(last, &task, sizeof(ecsTask));
+	}
+}
+
+/**
+ * \brief Appends a task pushed by a running system to the command buffer of its thread.
+ */
+static void ecsPushCommand(ECScommandBuffer* commands, ecsTask task)
+{
+	ECScommandSegment* segment = commands->segmentCount > 0 ? commands->segments + commands->segmentCount - 1 : NULL;
+	
+	// start a new segment unless the last one belongs to the same range
+	if(segment == NULL || segment->system != ecsThreadSystem || segment->begin != ecsThreadBegin)
+	{
+		ECScommandSegment* nptr = ecsReserve(commands->segments, &commands->segmentCapacity, commands->segmentCount + 1, sizeof(ECScommandSegment));
+		if(nptr == NULL) return;
+		commands->segments = nptr;
+		segment = commands->segments + commands->segmentCount++;
+		*segment = (ECScommandSegment) {
+			.system = ecsThreadSystem, .begin = ecsThreadBegin, .owner = ecsThreadIndex, .first = commands->tasks.size, .count = 0
+		};
+	}
+	
+	ecsTask* nptr = ecsReserve(commands->tasks.begin, &commands->tasks.capacity, commands->tasks.size + 1, sizeof(ecsTask));
+	if(nptr == NULL) return;
+	commands->tasks.begin = nptr;
+	commands->tasks.begin[commands->tasks.size++] = task;
+	segment->count++;
+}
+
+static inline void ecsRunTask(ecsTask task)
+{
+	switch(task.type)
+	{
+	default: return;
+		
+	case ECS_ENTITY_DESTROY:
+		ecsTaskDestroyEntity(task.entity);
+		return;
+
+	case ECS_COMPONENTS_DETACH:
+		ecsTaskDetachComponents(task.entity, task.components.mask);
+		return;
+		
+	case ECS_SYSTEM_CREATE:
+		ecsTaskEnableSystem(task.system);
+		return;
+	case ECS_SYSTEM_DESTROY:
+		ecsTaskDisableSystem(task.system);
+		return;
+		
+	case ECS_ENTITIES_CREATE:
+		ecsTaskCreateEntities(task.entity, task.count, task.components.mask);
+		return;
+	}
+}
+
+static int ecsCompareSegments(const void* a, const void* b)
+{
+	const ECScommandSegment* x = a;
+	const ECScommandSegment* y = b;
+	if(x->system != y->system)
+		return x->system < y->system ? -1 : 1;
+	return x->begin < y->begin ? -1 : x->begin > y->begin;
+}
+
+/**
+ * \brief Orders the segments of all command buffers by system and then entity range.
+ * \param merged Receives the ordered segments, allocated from the frame arena.
+ * \returns The number of segments in merged, ECS_NO_SLOT if there was no room to merge them.
+ */
+static size_t ecsMergeCommands(ECScommandSegment** merged)
+{
+	size_t participants = ecsWorkers.size + 1;
+	size_t count = 0;
+	for(size_t i = 0; i < participants; i++)
+		count += ecsWorkers.commands[i].segmentCount;
+	if(count == 0) return 0;
+	
+	*merged = ecsArenaPush(count * sizeof(ECScommandSegment));
+	if(*merged == NULL) return ECS_NO_SLOT;
+	
+	count = 0;
+	for(size_t i = 0; i < participants; i++)
+	{
+		if(ecsWorkers.commands[i].segmentCount == 0) continue;
+		memcpy(*merged + count, ecsWorkers.commands[i].segments, ecsWorkers.commands[i].segmentCount * sizeof(ECScommandSegment));
+		count += ecsWorkers.commands[i].segmentCount;
+	}
+	qsort(*merged, count, sizeof(ECScommandSegment), &ecsCompareSegments);
+	return count;
+}
+
+/**
+ * \brief Passes every queued task to fn, the global queue first and then tasks pushed by systems.
+ * \note Tasks pushed by systems are visited in order of system and then entity range, the same order a single thread would have pushed them in.
+ */
+static void ecsVisitTasks(void (*fn)(const ecsTask*))
+{
+	for(size_t i = 0; i < ecsTasks.size; i++)
+		fn(ecsTasks.begin + i);
+	
+	if(ecsWorkers.commands == NULL) return;
+	
+	size_t mark = ecsArena.used;
+	ECScommandSegment* merged = NULL;
+	size_t segments = ecsMergeCommands(&merged);
+	if(segments != ECS_NO_SLOT)
+	{
+		ECScommandSegment* segment;
+		for(size_t i = 0; i < segments; i++)
+		{
+			segment = merged + i;
+			for(size_t j = 0; j < segment->count; j++)
+				fn(ecsWorkers.commands[segment->owner].tasks.begin + segment->first + j);
+		}
+	}
+	else
+	{
+		// out of memory, visit each buffer in turn instead
+		for(size_t i = 0; i <= ecsWorkers.size; i++)
+		{
+			for(size_t j = 0; j < ecsWorkers.commands[i].tasks.size; j++)
+				fn(ecsWorkers.commands[i].tasks.begin + j);
+		}
+	}
+	ecsArenaRelease(mark);
+}
+
+/**
+ * \brief Adds the components of a detach task to those already queued for the same entity.
+ * \returns 0 if there was no room to queue it.
+ */
+static int ecsBatchDetach(ecsEntityId e, ecsComponentMask q)
+{
+	if(ecsFindEntityData(e) == NULL) return 1; // no such entity
+	
+	size_t index = ecsEntityIndex(e);
+	size_t pending = ecsDetachBatch.slots[index];
+	if(pending < ecsDetachBatch.size && ecsDetachBatch.begin[pending].index == index)
+	{
+		ecsDetachBatch.begin[pending].mask = ecsMaskOr(ecsDetachBatch.begin[pending].mask, q);
+		return 1;
+	}
+	
+	ECSpendingDetach* nptr = ecsReserve(ecsDetachBatch.begin, &ecsDetachBatch.capacity, ecsDetachBatch.size + 1, sizeof(ECSpendingDetach));
+	if(nptr == NULL) return 0;
+	ecsDetachBatch.begin = nptr;
+	
+	ecsDetachBatch.slots[index] = ecsDetachBatch.size;
+	ecsDetachBatch.begin[ecsDetachBatch.size++] = (ECSpendingDetach){ .index = index, .mask = q };
+	return 1;
+}
+
+static void ecsVisitRunTask(const ecsTask* task)
+{
+	ecsRunTask(*task);
+}
+
+/**
+ * \brief Runs a task, except for detaches which are combined per entity and run by ecsRunDetachBatch.
+ */
+static void ecsVisitBatchTask(const ecsTask* task)
+{
+	if(task->type != ECS_COMPONENTS_DETACH || !ecsBatchDetach(task->entity, task->components.mask))
+		ecsRunTask(*task);
+}
+
+/**
+ * \brief Moves every entity with queued detaches straight to its final archetype.
+ */
+static void ecsRunDetachBatch()
+{
+	unsigned long long start = ecsTracer.capacity > 0 ? ecsNow() : 0;
+	size_t count = ecsDetachBatch.size;
+	ECSarchetype* from = NULL;
+	ECSarchetype* to = NULL;
+	ecsComponentMask fromMask = nocomponent;
+	ECSpendingDetach* pending;
+	ECSentityData* entity;
+	
+	for(size_t i = 0; i < ecsDetachBatch.size; i++)
+	{
+		pending = ecsDetachBatch.begin + i;
+		entity = ecsEntities.begin + pending->index;
+		if(entity->archetype == NULL) continue;							// destroyed after the detach was queued
+		if(!ecsMaskIntersects(entity->mask, pending->mask)) continue;	// entity has none of the components
+		
+		// entities spawned together share an archetype, only look up the destination when it changes
+		if(entity->archetype != from || !ecsMaskEqual(pending->mask, fromMask))
+		{
+			from = entity->archetype;
+			fromMask = pending->mask;
+			to = ecsGetArchetype(ecsMaskAndNot(from->mask, pending->mask));
+		}
+		ecsMoveEntity(entity, to, ecsMaskAndNot(entity->mask, pending->mask), NULL, NULL);
+	}
+	ecsDetachBatch.size = 0;
+	
+	if(ecsTracer.capacity > 0 && count > 0)
+		ecsTrace(0, "detach batch", 0, start, ecsNow() - start, count);
+}
+
+void ecsRunTasks()
+{
+	// slots created by tasks have to be part of the entities list first
+	if(!ecsClaimReservedSlots()) return;
+	
+	size_t count = ecsTasks.size;
+	for(size_t i = 0; ecsWorkers.commands != NULL && i <= ecsWorkers.size; i++)
+		count += ecsWorkers.commands[i].tasks.size;
+	if(count == 0)
+	{
+		ecsReleaseReservedSlots();
+		return;
+	}
+	unsigned long long start = ecsTiming() ? ecsNow() : 0;
+	
+	// detaching is order independent and destroyed entities are skipped, so every entity moves at most once
+	if(ecsResizeDetachSlots(ecsEntities.size))
+	{
+		ecsVisitTasks(&ecsVisitBatchTask);
+		ecsRunDetachBatch();
+	}
+	else
+		ecsVisitTasks(&ecsVisitRunTask); // out of memory, run tasks one at a time
+	
+	// keep the buffers around for the next frame
+	ecsClearTasks();
+	for(size_t i = 0; ecsWorkers.commands != NULL && i <= ecsWorkers.size; i++)
+	{
+		ecsWorkers.commands[i].tasks.size = 0;
+		ecsWorkers.commands[i].segmentCount = 0;
+	}
+	ecsReleaseReservedSlots();
+	ecsArenaTrim();
+	
+	if(ecsTiming())
+	{
+		unsigned long long time = ecsNow() - start;
+		ecsProfiler.taskTime += time;
+		ecsProfiler.taskCount += count;
+		ecsTrace(0, "ecsRunTasks", 0, start, time, count);
+	}
+}
+
+//
+// PROFILING
+//
+
+static inline int ecsTiming()
+{
+	return ecsProfiler.capacity > 0 || ecsTracer.capacity > 0;
+}
+
+static inline unsigned long long ecsNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+static int ecsStartProfiler(size_t frameCount)
+{
+	size_t threadCount = ecsWorkers.size + 1;
+	ecsProfiler.frames = ecsCalloc(frameCount, sizeof(ecsFrameProfile));
+	ecsProfiler.systemCapacities = ecsCalloc(frameCount, sizeof(size_t));
+	ecsProfiler.threads = ecsCalloc(threadCount * (frameCount + 1), sizeof(ecsThreadProfile));
+	if(ecsProfiler.frames == NULL || ecsProfiler.systemCapacities == NULL || ecsProfiler.threads == NULL)
+	{
+		ecsStopProfiler();
+		return 0;
+	}
+	
+	// every frame gets its own slice of the thread profiles, after the one for the current frame
+	for(size_t i = 0; i < frameCount; i++)
+	{
+		ecsProfiler.frames[i].threadCount = threadCount;
+		ecsProfiler.frames[i].threads = ecsProfiler.threads + threadCount * (i + 1);
+	}
+	ecsProfiler.capacity = frameCount;
+	return 1;
+}
+
+static void ecsStopProfiler()
+{
+	for(size_t i = 0; ecsProfiler.frames != NULL && i < ecsProfiler.capacity; i++)
+		ecsFree(ecsProfiler.frames[i].systems);
+	ecsFree(ecsProfiler.frames);
+	ecsFree(ecsProfiler.systemCapacities);
+	ecsFree(ecsProfiler.threads);
+	memset(&ecsProfiler, 0x0, sizeof(ecsProfiler));
+}
+
+/**
+ * \brief Records a range of count entities of a system that thread self started running at start.
+ */
+static inline void ecsTimeRange(size_t self, size_t index, unsigned long long start, size_t count)
+{
+	unsigned long long time = ecsNow() - start;
+	ecsTrace(self, ecsSystems.begin[index].name, self, start, time, count);
+	if(ecsProfiler.capacity == 0)
+		return;
+	
+	// each thread only touches its own profile, systems are shared between threads
+	ECSsystemState* state = ecsSystems.begin[index].state;
+	ecsProfiler.threads[self].busyTime += time;
+	ecsProfiler.threads[self].rangeCount++;
+	atomic_fetch_add_explicit(&state->rangeTime, time, memory_order_relaxed);
+	atomic_fetch_add_explicit(&state->rangeCount, 1, memory_order_relaxed);
+}
+
+static void ecsBeginProfiledFrame()
+{
+	ecsProfiler.frameStart = ecsNow();
+	memset(ecsProfiler.threads, 0x0, (ecsWorkers.size + 1) * sizeof(ecsThreadProfile));
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		ecsSystems.begin[i].state->startTime = ecsSystems.begin[i].state->finishTime = 0;
+		ecsSystems.begin[i].state->gatherTime = 0;
+		ecsSystems.begin[i].state->entityCount = 0;
+		atomic_store_explicit(&ecsSystems.begin[i].state->rangeTime, 0, memory_order_relaxed);
+		atomic_store_explicit(&ecsSystems.begin[i].state->rangeCount, 0, memory_order_relaxed);
+	}
+}
+
+static void ecsEndProfiledFrame()
+{
+	size_t slot = ecsProfiler.frameCount % ecsProfiler.capacity;
+	ecsFrameProfile* frame = ecsProfiler.frames + slot;
+	
+	// systems may have been enabled since this slot was last used
+	ecsSystemProfile* systems = ecsReserve(frame->systems, ecsProfiler.systemCapacities + slot, ecsSystems.size, sizeof(ecsSystemProfile));
+	if(systems == NULL && ecsSystems.size > 0) return; // out of memory, drop the frame
+	frame->systems = systems;
+	
+	// systems enabled by tasks of this frame did not run yet
+	frame->systemCount = 0;
+	ECSsystem* system;
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		system = ecsSystems.begin + i;
+		if(system->state->startTime == 0)
+			continue;
+		
+		frame->systems[frame->systemCount++] = (ecsSystemProfile) {
+			.name = system->name,
+			.fn = system->fn,
+			.columnFn = system->columnFn,
+			.startTime = system->state->startTime - ecsProfiler.frameStart,
+			.wallTime = system->state->finishTime - system->state->startTime,
+			.gatherTime = system->state->gatherTime,
+			.rangeTime = atomic_load_explicit(&system->state->rangeTime, memory_order_relaxed),
+			.rangeCount = atomic_load_explicit(&system->state->rangeCount, memory_order_relaxed),
+			.entityCount = system->state->entityCount
+		};
+	}
+	memcpy(frame->threads, ecsProfiler.threads, frame->threadCount * sizeof(ecsThreadProfile));
+	
+	frame->frame = ecsProfiler.frameCount++;
+	frame->wallTime = ecsNow() - ecsProfiler.frameStart;
+	frame->taskTime = ecsProfiler.taskTime;
+	frame->taskCount = ecsProfiler.taskCount;
+	ecsProfiler.taskTime = 0;
+	ecsProfiler.taskCount = 0;
+}
+
+size_t ecsGetProfiledFrameCount()
+{
+	return ecsProfiler.frameCount < ecsProfiler.capacity ? ecsProfiler.frameCount : ecsProfiler.capacity;
+}
+
+const ecsFrameProfile* ecsGetFrameProfile(size_t age)
+{
+	if(age >= ecsGetProfiledFrameCount()) return NULL;
+	return ecsProfiler.frames + (ecsProfiler.frameCount - 1 - age) % ecsProfiler.capacity;
+}
+
+/**
+ * \brief Appends an event to the trace buffer of thread self, if tracing.
+ * \note Structural changes only happen on the thread calling ecsRunSystems, which is thread 0.
+ */
+static inline void ecsTrace(size_t self, const char* name, size_t track, unsigned long long start, unsigned long long duration, size_t count)
+{
+	if(ecsTracer.capacity == 0) return;
+	
+	ECStraceBuffer* buffer = ecsTracer.buffers + self;
+	if(buffer->size == ecsTracer.capacity)
+	{
+		buffer->dropped++;
+		return;
+	}
+	buffer->events[buffer->size++] = (ECStraceEvent) {
+		.name = name, .start = start, .duration = duration, .track = track, .count = count
+	};
+}
+
+int ecsStartTrace(size_t eventsPerThread)
+{
+	ecsStopTrace();
+	if(eventsPerThread == 0) return 0;
+	
+	// allocate every buffer up front so threads never have to synchronize while tracing
+	size_t bufferCount = ecsWorkers.size + 1;
+	ecsTracer.buffers = ecsCalloc(bufferCount, sizeof(ECStraceBuffer));
+	if(ecsTracer.buffers == NULL) return 0;
+	ecsTracer.bufferCount = bufferCount;
+	for(size_t i = 0; i < bufferCount; i++)
+	{
+		ecsTracer.buffers[i].events = ecsMalloc(eventsPerThread * sizeof(ECStraceEvent));
+		if(ecsTracer.buffers[i].events == NULL)
+		{
+			ecsStopTrace();
+			return 0;
+		}
+	}
+	
+	ecsTracer.origin = ecsNow();
+	ecsTracer.capacity = eventsPerThread;
+	return 1;
+}
+
+void ecsStopTrace()
+{
+	for(size_t i = 0; i < ecsTracer.bufferCount; i++)
+		ecsFree(ecsTracer.buffers[i].events);
+	ecsFree(ecsTracer.buffers);
+	memset(&ecsTracer, 0x0, sizeof(ecsTracer));
+}
+
+static void ecsWriteJsonString(FILE* file, const char* string)
+{
+	fputc('"', file);
+	for(; *string != '\0'; string++)
+	{
+		if(*string == '"' || *string == '\\')
+			fputc('\\', file);
+		if((unsigned char)*string >= 0x20)
+			fputc(*string, file);
 	}
-	if(threads != NULL)
-		free(threads);
-	if(threadArgs != NULL)
-		free(threadArgs);
-	
-	ecsRunTasks();
+	fputc('"', file);
 }
 
-void ecsSortSystems()
+int ecsWriteTrace(const char* path)
 {
-	int swaps;
-	ECSsystem tmp;
+	if(ecsTracer.capacity == 0) return 0;
 	
-	do
+	FILE* file = fopen(path, "w");
+	if(file == NULL) return 0;
+	
+	// name the thread and system tracks
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for(size_t i = 0; i < ecsTracer.bufferCount; i++)
 	{
-		swaps = 0;
-		for(int i = 1; i < ecsSystems.size; ++i)
+		fprintf(file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", i);
+		ecsWriteJsonString(file, i == 0 ? "main thread" : "worker");
+		fprintf(file, "}},\n");
+	}
+	for(size_t i = 0; i < ecsSystems.size; i++)
+	{
+		fprintf(file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", ECS_TRACE_SYSTEM_TRACK + i);
+		ecsWriteJsonString(file, ecsSystems.begin[i].name != NULL ? ecsSystems.begin[i].name : "system");
+		fprintf(file, "}},\n");
+	}
+	
+	// timestamps are in microseconds relative to the start of the trace
+	ECStraceEvent* event;
+	size_t dropped = 0;
+	for(size_t i = 0; i < ecsTracer.bufferCount; i++)
+	{
+		dropped += ecsTracer.buffers[i].dropped;
+		for(size_t j = 0; j < ecsTracer.buffers[i].size; j++)
 		{
-			if(ecsSystems.begin[i-1].execOrder > ecsSystems.begin[i].execOrder)
-			{
-				memcpy(&tmp, &ecsSystems.begin[i-1], sizeof(ECSsystem));
-				memcpy(&ecsSystems.begin[i-1], &ecsSystems.begin[i], sizeof(ECSsystem));
-				memcpy(&ecsSystems.begin[i], &tmp, sizeof(ECSsystem));
-				swaps++;
-			}
+			event = ecsTracer.buffers[i].events + j;
+			fprintf(file, "{\"name\":");
+			ecsWriteJsonString(file, event->name != NULL ? event->name : "system");
+			fprintf(file, ",\"pid\":1,\"tid\":%zu,\"ts\":%.3f", event->track, (double)(event->start - ecsTracer.origin) / 1000.0);
+			if(event->duration == ECS_TRACE_INSTANT)
+				fprintf(file, ",\"ph\":\"i\",\"s\":\"t\"");
+			else
+				fprintf(file, ",\"ph\":\"X\",\"dur\":%.3f", (double)event->duration / 1000.0);
+			fprintf(file, ",\"args\":{\"count\":%zu}},\n", event->count);
 		}
 	}
-	while(swaps > 0);
+	fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"ecs\",\"dropped events\":%zu}}\n]}\n", dropped);
+	
+	return fclose(file) == 0;
 }
 
-void ecsEnableSystem(ecsSystemFn fn, ecsComponentMask query, ecsQueryComparison comp, int maxThreads, int execOrder)
+//
+// FIND HELPERS
+//
+
+static inline ECScomponentType* ecsFindComponentType(ecsComponentMask id)
 {
-	ecsPushTask((ecsTask)
-	{
-		.type=ECS_SYSTEM_CREATE,
-		.system=(ECSsystem)
-		{
-			.fn = fn,
-			.maxThreads = maxThreads,
-			.execOrder = execOrder,
-			.query=(ecsComponentQuery)
-			{
-				.mask=query,
-				.comparison=comp
-			}
-		}
-	});
+	// a component type's index is the position of its only bit
+	size_t i = ecsMaskNext(&id, 0);
+	if(i < ecsComponents.size && ecsMaskEqual(ecsComponents.begin[i].id, id))
+		return (ecsComponents.begin + i);
+	return NULL;
 }
 
-void ecsTaskEnableSystem(ECSsystem system)
+static inline ECSarchetype* ecsFindArchetype(ecsComponentMask mask)
 {
-	if(ecsResizeSystems(ecsSystems.size + 1))
+	if(ecsArchetypes.mapCapacity == 0) return NULL;
+	
+	size_t last = ecsArchetypes.mapCapacity - 1;
+	for(size_t slot = ecsHashMask(mask) & last; ecsArchetypes.map[slot] != NULL; slot = (slot + 1) & last)
 	{
-		ECSsystem* last = (ecsSystems.begin + ecsSystems.size - 1);
-		memcpy(last, &system, sizeof(ECSsystem));
-		ecsSortSystems();
+		if(ecsMaskEqual(ecsArchetypes.map[slot]->mask, mask))
+			return ecsArchetypes.map[slot];
 	}
+	return NULL;
 }
 
-void ecsDisableSystem(ecsSystemFn fn)
-{ ecsPushTask((ecsTask){ .type=ECS_SYSTEM_DESTROY, .system=fn }); }
-void ecsTaskDisableSystem(ecsSystemFn fn)
+static inline ECSentityData* ecsFindEntityData(ecsEntityId id)
 {
-	// calculate distance between end and to replace
-	ECSsystem* to_replace = ecsFindSystem(fn);
-	ECSsystem* end = ecsSystems.begin + ecsSystems.size;
-	size_t dist = (end - to_replace) - 1;
-
-	// shift everything after to-be-deleted item back by one (overwriting to-be-deleted)
-	memmove(to_replace, to_replace + 1, dist * sizeof(ECSsystem));
+	size_t index = ecsEntityIndex(id);
+	if(index >= ecsEntities.size) return NULL;
+	
+	// the slot is either free or reused by a newer version of the entity
+	ECSentityData* data = ecsEntities.begin + index;
+	if(data->archetype == NULL || data->id != id) return NULL;
+	
+	return data;
+}
 
-	// resize array
-	ecsResizeSystems(ecsSystems.size - 1);
+static inline ECSsystem* ecsFindSystem(ecsSystemFn fn, ecsColumnSystemFn columnFn)
+{
+	for(size_t i = 0; i < ecsSystems.size; ++i)
+	{
+		if(ecsSystems.begin[i].fn == fn && ecsSystems.begin[i].columnFn == columnFn)
+			return (ecsSystems.begin + i);
+	}
+	return NULL;
 }
 
 //
-// TASKS
+// RESIZE HELPERS
 //
 
-void ecsPushTask(ecsTask task)
+static inline void* ecsMalloc(size_t size)
 {
-	if(ecsPushTaskStack())
+	return ecsCurrentWorld->allocator.allocate(ecsCurrentWorld->allocator.user, size);
+}
+
+static inline void* ecsCalloc(size_t count, size_t size)
+{
+	if(size > 0 && count > SIZE_MAX / size) return NULL;
+	
+	void* ptr = ecsMalloc(count * size);
+	if(ptr != NULL)
+		memset(ptr, 0x0, count * size);
+	return ptr;
+}
+
+static inline void* ecsRealloc(void* ptr, size_t size)
+{
+	return ecsCurrentWorld->allocator.reallocate(ecsCurrentWorld->allocator.user, ptr, size);
+}
+
+static inline void ecsFree(void* ptr)
+{
+	ecsCurrentWorld->allocator.release(ecsCurrentWorld->allocator.user, ptr);
+}
+
+static inline size_t ecsArenaHeaderSize()
+{
+	return (sizeof(ECSarenaBlock) + ECS_ARENA_ALIGN - 1) & ~(size_t)(ECS_ARENA_ALIGN - 1);
+}
+
+static ECSarenaBlock* ecsArenaAddBlock(size_t capacity)
+{
+	ECSarenaBlock* block = ecsMalloc(ecsArenaHeaderSize() + capacity);
+	if(block == NULL) return NULL;
+	
+	block->previous = ecsArena.top;
+	block->base = ecsArena.used;
+	block->capacity = capacity;
+	block->used = 0;
+	ecsArena.top = block;
+	return block;
+}
+
+/**
+ * \brief Allocates size bytes from the frame arena.
+ * \returns The memory, aligned to ECS_ARENA_ALIGN, NULL if out of memory.
+ * \note Only the thread calling ecsRunTasks may use the arena.
+ */
+static void* ecsArenaPush(size_t size)
+{
+	size = (size + ECS_ARENA_ALIGN - 1) & ~(size_t)(ECS_ARENA_ALIGN - 1);
+	
+	ECSarenaBlock* block = ecsArena.top;
+	if(block == NULL || block->capacity - block->used < size)
 	{
-		ecsTask* last = ecsTasks.begin + ecsTasks.size - 1;
-		memmove(last, &task, sizeof(ecsTask));
+		size_t capacity = block != NULL ? block->capacity * 2 : ECS_ARENA_MIN_CAPACITY;
+		block = ecsArenaAddBlock(capacity > size ? capacity : size);
+		if(block == NULL) return NULL;
 	}
+	
+	void* ptr = (BYTE*)block + ecsArenaHeaderSize() + block->used;
+	block->used += size;
+	ecsArena.used += size;
+	if(ecsArena.used > ecsArena.peak)
+		ecsArena.peak = ecsArena.used;
+	return ptr;
 }
 
-static inline void ecsRunTask(ecsTask task)
+/**
+ * \brief Releases everything allocated from the frame arena since ecsArena.used was mark.
+ */
+static void ecsArenaRelease(size_t mark)
 {
-	switch(task.type)
+	assert(mark <= ecsArena.used);
+	
+	// blocks added after the mark only made room for the peak, keep the first one
+	ECSarenaBlock* block;
+	while(ecsArena.top != NULL && ecsArena.top->previous != NULL && ecsArena.top->base >= mark)
 	{
-	default: return;
-		
-	case ECS_ENTITY_DESTROY:
-		ecsTaskDestroyEntity(task.entity);
-		return;
+		block = ecsArena.top;
+		ecsArena.top = block->previous;
+		ecsFree(block);
+	}
+	if(ecsArena.top != NULL)
+		ecsArena.top->used = mark - ecsArena.top->base;
+	ecsArena.used = mark;
+}
 
-	case ECS_COMPONENTS_DETACH:
-		ecsTaskDetachComponents(task.entity, task.components.mask);
-		return;
-		
-	case ECS_SYSTEM_CREATE:
-		ecsTaskEnableSystem(task.system);
-		return;
-	case ECS_SYSTEM_DESTROY:
-		ecsTaskDisableSystem(task.system.fn);
+/**
+ * \brief Grows the first block of an empty frame arena to the peak usage so the next frame fits in one block.
+ */
+static void ecsArenaTrim()
+{
+	if(ecsArena.used > 0 || ecsArena.top == NULL || ecsArena.peak <= ecsArena.top->capacity)
+	{
+		ecsArena.peak = 0;
 		return;
 	}
+	
+	size_t capacity = ecsArena.peak;
+	ecsArenaFree();
+	ecsArenaAddBlock(capacity);
 }
 
-void ecsRunTasks()
+static void ecsArenaFree()
 {
-	for(size_t i = 0; i < ecsTasks.size; i++)
-		ecsRunTask(ecsTasks.begin[i]);
-	ecsClearTasks();
+	assert(ecsArena.used == 0);
+	
+	ECSarenaBlock* block;
+	while(ecsArena.top != NULL)
+	{
+		block = ecsArena.top;
+		ecsArena.top = block->previous;
+		ecsFree(block);
+	}
+	ecsArena.peak = 0;
 }
 
-//
-// FIND HELPERS
-//
+static inline BYTE* ecsAlignChunk(BYTE* ptr)
+{
+	return (BYTE*)(((uintptr_t)ptr + ECS_MAX_COMPONENT_ALIGN - 1) & ~(uintptr_t)(ECS_MAX_COMPONENT_ALIGN - 1));
+}
 
-static inline ECScomponentType* ecsFindComponentType(ecsComponentMask id)
+/**
+ * \brief Allocates storage of an archetype chunk, taking chunks of the usual size from the pool.
+ * \returns Storage aligned to ECS_MAX_COMPONENT_ALIGN, NULL if out of memory.
+ */
+static void* ecsAllocChunk(size_t size)
 {
-	for(size_t i = 0; i < ecsComponents.size; ++i)
+	if(size != ECS_CHUNK_SIZE)
 	{
-		if(ecsComponents.begin[i].id == id)
-			return (ecsComponents.begin + i);
+		// remember where the allocation starts right in front of the aligned storage
+		BYTE* block = ecsMalloc(size + ECS_MAX_COMPONENT_ALIGN + sizeof(void*));
+		if(block == NULL) return NULL;
+		
+		BYTE* chunk = ecsAlignChunk(block + sizeof(void*));
+		((void**)chunk)[-1] = block;
+		return chunk;
 	}
-	return NULL;
+	
+	if(ecsChunkPool.freeList == NULL)
+	{
+		BYTE** slabs = ecsReserve(ecsChunkPool.slabs, &ecsChunkPool.slabCapacity, ecsChunkPool.slabCount + 1, sizeof(BYTE*));
+		if(slabs == NULL) return NULL;
+		ecsChunkPool.slabs = slabs;
+		
+		BYTE* slab = ecsMalloc(ECS_POOL_SLAB_CHUNKS * ECS_CHUNK_SIZE + ECS_MAX_COMPONENT_ALIGN);
+		if(slab == NULL) return NULL;
+		ecsChunkPool.slabs[ecsChunkPool.slabCount++] = slab;
+		slab = ecsAlignChunk(slab);
+		
+		// hand out the slab front to back
+		for(size_t i = ECS_POOL_SLAB_CHUNKS; i-- > 0;)
+			ecsFreeChunk(slab + i * ECS_CHUNK_SIZE, ECS_CHUNK_SIZE);
+	}
+	
+	void* chunk = ecsChunkPool.freeList;
+	ecsChunkPool.freeList = *(void**)chunk;
+	ecsChunkPool.freeCount--;
+	return chunk;
 }
 
-void* ecsFindComponentFor(ECScomponentType* type, ecsEntityId id)
+static void ecsFreeChunk(void* chunk, size_t size)
 {
-	if(type->size == 0) return NULL;
-
-	BYTE* sptr;
-	ecsEntityId* eptr;
-	int l = 0;
-	int r = type->size - 1;
-	int m;
-
-	while(l <= r)
+	if(size != ECS_CHUNK_SIZE)
 	{
-		m = round((double)(l+r)/2.f);
-		sptr = ((BYTE*)type->begin) + m * type->stride; // median element
-		eptr = sptr;
-
-		// found the correct component
-		if(*eptr == id)
-			return sptr;
-		// go up
-		else if(*eptr < id)
-			l = m + 1;
-		// go down
-		else if(*eptr > id)
-			r = m - 1;
+		ecsFree(((void**)chunk)[-1]);
+		return;
 	}
-	return NULL;
+	
+	*(void**)chunk = ecsChunkPool.freeList;
+	ecsChunkPool.freeList = chunk;
+	ecsChunkPool.freeCount++;
 }
 
-static inline ECSentityData* ecsFindEntityData(ecsEntityId id)
+static int ecsCompareSlabs(const void* a, const void* b)
 {
-	for(size_t i = 0; i < ecsEntities.size; ++i)
+	const BYTE* x = *(BYTE* const*)a;
+	const BYTE* y = *(BYTE* const*)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * \brief Index of the slab a pooled chunk belongs to, the slabs have to be sorted.
+ */
+static size_t ecsFindSlab(const BYTE* chunk)
+{
+	size_t first = 0;
+	size_t count = ecsChunkPool.slabCount;
+	size_t half;
+	while(count > 1)
 	{
-		if(ecsEntities.begin[i].id == id)
-			return (ecsEntities.begin + i);
+		half = count / 2;
+		if(ecsChunkPool.slabs[first + half] <= chunk)
+			first += half;
+		count -= half;
 	}
-	return NULL;
+	return first;
 }
 
-static inline ECSsystem* ecsFindSystem(ecsSystemFn fn)
+/**
+ * \brief Frees the slabs of the chunk pool that have no chunk in use.
+ */
+static void ecsTrimChunkPool()
 {
-	for(size_t i = 0; i < ecsSystems.size; ++i)
+	if(ecsChunkPool.freeCount < ECS_POOL_SLAB_CHUNKS) return;
+	
+	size_t mark = ecsArena.used;
+	size_t* freeCounts = ecsArenaPush(ecsChunkPool.slabCount * sizeof(size_t));
+	if(freeCounts == NULL) return;
+	memset(freeCounts, 0x0, ecsChunkPool.slabCount * sizeof(size_t));
+	
+	qsort(ecsChunkPool.slabs, ecsChunkPool.slabCount, sizeof(BYTE*), &ecsCompareSlabs);
+	for(void* chunk = ecsChunkPool.freeList; chunk != NULL; chunk = *(void**)chunk)
+		freeCounts[ecsFindSlab(chunk)]++;
+	
+	// unlink the chunks of unused slabs before freeing them
+	void** link = &ecsChunkPool.freeList;
+	while(*link != NULL)
 	{
-		if(ecsSystems.begin[i].fn == fn)
-			return (ecsSystems.begin + i);
+		if(freeCounts[ecsFindSlab(*link)] == ECS_POOL_SLAB_CHUNKS)
+		{
+			*link = *(void**)*link;
+			ecsChunkPool.freeCount--;
+		}
+		else
+			link = (void**)*link;
 	}
-	return NULL;
+	
+	size_t kept = 0;
+	for(size_t i = 0; i < ecsChunkPool.slabCount; i++)
+	{
+		if(freeCounts[i] == ECS_POOL_SLAB_CHUNKS)
+			ecsFree(ecsChunkPool.slabs[i]);
+		else
+			ecsChunkPool.slabs[kept++] = ecsChunkPool.slabs[i];
+	}
+	ecsChunkPool.slabCount = kept;
+	ecsChunkPool.slabs = ecsShrink(ecsChunkPool.slabs, &ecsChunkPool.slabCapacity, kept, sizeof(BYTE*));
+	
+	ecsArenaRelease(mark);
 }
 
-//
-// RESIZE HELPERS
-//
+static void ecsFreeChunkPool()
+{
+	for(size_t i = 0; i < ecsChunkPool.slabCount; i++)
+		ecsFree(ecsChunkPool.slabs[i]);
+	if(ecsChunkPool.slabs) ecsFree(ecsChunkPool.slabs);
+	memset(&ecsChunkPool, 0x0, sizeof(ecsChunkPool));
+}
 
-static inline int ecsResizeSystems(size_t size)
+/**
+ * \brief Grows a buffer to hold at least count elements, doubling its capacity as needed.
+ * \returns The possibly moved buffer, NULL if allocation failed.
+ * \note capacity is only updated when the buffer could be grown.
+ */
+static inline void* ecsReserve(void* begin, size_t* capacity, size_t count, size_t elementSize)
 {
-	if(size == 0)
-	{
-		free(ecsSystems.begin);
-		ecsSystems.begin = NULL;
-		ecsSystems.size = 0;
-	}
-	else
+	if(count <= *capacity) return begin;
+	
+	size_t ncapacity = *capacity > 0 ? *capacity : ECS_MIN_CAPACITY;
+	while(ncapacity < count)
+		ncapacity *= 2;
+	
+	void* nptr = ecsRealloc(begin, ncapacity * elementSize);
+	if(nptr == NULL) return NULL;
+	
+	*capacity = ncapacity;
+	return nptr;
+}
+
+/**
+ * \brief Shrinks a buffer to exactly count elements.
+ * \returns The possibly moved buffer, NULL if count is 0.
+ */
+static inline void* ecsShrink(void* begin, size_t* capacity, size_t count, size_t elementSize)
+{
+	if(count == 0)
 	{
-		ECSsystem* nptr = realloc(ecsSystems.begin, size * sizeof(ECSsystem));
-		if(nptr == NULL) return 0;
-		
-		ecsSystems.size = size;
-		ecsSystems.begin = nptr;
+		ecsFree(begin);
+		*capacity = 0;
+		return NULL;
 	}
+	if(count >= *capacity) return begin;
+	
+	void* nptr = ecsRealloc(begin, count * elementSize);
+	if(nptr == NULL) return begin; // keep the larger buffer
+	
+	*capacity = count;
+	return nptr;
+}
+
+static inline int ecsResizeSystems(size_t size)
+{
+	ECSsystem* nptr = ecsReserve(ecsSystems.begin, &ecsSystems.capacity, size, sizeof(ECSsystem));
+	if(nptr == NULL && size > 0) return 0;
+	
+	ecsSystems.size = size;
+	ecsSystems.begin = nptr;
 	return 1;
 }
 
 static inline int ecsPushTaskStack()
 {
 	size_t size = ecsTasks.size + 1;
-	void* nptr = realloc(ecsTasks.begin, size * sizeof(ecsTask));
+	ecsTask* nptr = ecsReserve(ecsTasks.begin, &ecsTasks.capacity, size, sizeof(ecsTask));
 	if(nptr == NULL) return 0;
 	
 	ecsTasks.size = size;
@@ -656,69 +3755,134 @@ static inline int ecsPushTaskStack()
 
 static inline void ecsClearTasks()
 {
-	if(ecsTasks.begin == NULL || ecsTasks.size == 0) return; // no tasks
-	
+	// keep the buffer around for the next frame
 	ecsTasks.size = 0;
-	free(ecsTasks.begin);
-	ecsTasks.begin = NULL;
 }
 
 static inline int ecsResizeEntities(size_t size)
 {
-	if(size == 0)
+	ECSentityData* nptr = ecsReserve(ecsEntities.begin, &ecsEntities.capacity, size, sizeof(ECSentityData));
+	if(nptr == NULL && size > 0) return 0;
+	
+	ecsEntities.size = size;
+	ecsEntities.begin = nptr;
+	return 1;
+}
+
+static inline int ecsResizeChunks(ECSarchetype* archetype, size_t size)
+{
+	// release chunks beyond the new size
+	for(size_t i = size; i < archetype->chunkCount; i++)
+		ecsFreeChunk(archetype->chunks[i].data, archetype->chunkBytes);
+	
+	if(size <= archetype->chunkCount)
 	{
-		free(ecsEntities.begin);
-		ecsEntities.begin = NULL;
-		ecsEntities.size = 0;
+		archetype->chunkCount = size;
+		return 1;
 	}
-	else
+	
+	ECSchunk* nptr = ecsReserve(archetype->chunks, &archetype->chunksCapacity, size, sizeof(ECSchunk));
+	if(nptr == NULL) return 0;
+	archetype->chunks = nptr;
+	
+	// allocate chunks beyond the old size
+	for(size_t i = archetype->chunkCount; i < size; i++)
 	{
-		ECSentityData* nptr = realloc(ecsEntities.begin, size * sizeof(ECSentityData));
-		if(nptr == NULL) return 0;
-		
-		ecsEntities.size = size;
-		ecsEntities.begin = nptr;
+		nptr[i].count = 0;
+		nptr[i].data = ecsAllocChunk(archetype->chunkBytes);
+		if(nptr[i].data == NULL)
+		{
+			archetype->chunkCount = i;
+			return 0;
+		}
+		for(size_t j = 0; j < archetype->columnCount; j++)
+			atomic_init(ecsChunkTicks(archetype, nptr + i) + j, 0);
 	}
+	
+	if(ecsTracer.capacity > 0)
+		ecsTrace(0, "chunks allocated", 0, ecsNow(), ECS_TRACE_INSTANT, size - archetype->chunkCount);
+	
+	archetype->chunkCount = size;
 	return 1;
 }
 
-static inline int ecsResizeComponentType(ECScomponentType* type, size_t size)
+static inline int ecsResizeArchetypes(size_t size)
 {
-	if(size == 0)
-	{
-		if (type->begin == NULL) return 1;
+	ECSarchetype** nptr = ecsReserve(ecsArchetypes.begin, &ecsArchetypes.capacity, size, sizeof(ECSarchetype*));
+	if(nptr == NULL && size > 0) return 0;
+	
+	ecsArchetypes.size = size;
+	ecsArchetypes.begin = nptr;
+	return 1;
+}
 
-		free(type->begin);
-		type->begin = NULL;
-		type->size = 0;
-	}
-	else
-	{
-		void* nptr = realloc(type->begin, size * (type->stride));
-		assert(nptr != NULL);
-		if(nptr == NULL) return 0;
-		
-		type->size = size;
-		type->begin = nptr;
-	}
+static inline int ecsResizeArchetypeMap(size_t size)
+{
+	size_t capacity = ECS_MIN_CAPACITY;
+	while(capacity < size)
+		capacity *= 2;
+	
+	ECSarchetype** nptr = ecsCalloc(capacity, sizeof(ECSarchetype*));
+	if(nptr == NULL) return 0;
+	
+	ecsFree(ecsArchetypes.map);
+	ecsArchetypes.map = nptr;
+	ecsArchetypes.mapCapacity = capacity;
+	
+	// rehash every archetype into the new table
+	for(size_t i = 0; i < ecsArchetypes.size; i++)
+		ecsMapArchetype(ecsArchetypes.begin[i]);
+	return 1;
+}
+
+/**
+ * \brief Makes room in the detach batch for entity slots below size.
+ */
+static inline int ecsResizeDetachSlots(size_t size)
+{
+	size_t capacity = ecsDetachBatch.slotCapacity;
+	size_t* nptr = ecsReserve(ecsDetachBatch.slots, &capacity, size, sizeof(size_t));
+	if(nptr == NULL && size > 0) return 0;
+	
+	// slots never written to must not point back by accident
+	if(capacity > ecsDetachBatch.slotCapacity)
+		memset(nptr + ecsDetachBatch.slotCapacity, 0xFF, (capacity - ecsDetachBatch.slotCapacity) * sizeof(size_t));
+	
+	ecsDetachBatch.slots = nptr;
+	ecsDetachBatch.slotCapacity = capacity;
 	return 1;
 }
 
 static inline int ecsResizeComponents(size_t size)
 {
-	if(size == 0)
-	{
-		free(ecsComponents.begin);
-		ecsComponents.size = 0;
-		ecsComponents.begin = NULL;
-	}
-	else
+	ECScomponentType* nptr = ecsReserve(ecsComponents.begin, &ecsComponents.capacity, size, sizeof(ECScomponentType));
+	if(nptr == NULL && size > 0) return 0;
+	
+	ecsComponents.begin = nptr;
+	ecsComponents.size = size;
+	return 1;
+}
+
+static inline int ecsResizeViews(ECSviewList* views, size_t size)
+{
+	ECSchunkView* nptr = ecsReserve(views->begin, &views->capacity, size, sizeof(ECSchunkView));
+	if(nptr == NULL && size > 0) return 0;
+	
+	views->begin = nptr;
+	return 1;
+}
+
+/**
+ * \brief Releases chunks left empty by removed rows.
+ */
+static inline void ecsTrimArchetypes()
+{
+	ECSarchetype* archetype;
+	for(size_t i = 0; i < ecsArchetypes.size; i++)
 	{
-		ECScomponentType* nptr = realloc(ecsComponents.begin, size * sizeof(ECScomponentType));
-		if(nptr == NULL) return 0;
-		
-		ecsComponents.begin = nptr;
-		ecsComponents.size = size;
+		archetype = ecsArchetypes.begin[i];
+		size_t used = (archetype->count + archetype->chunkCapacity - 1) / archetype->chunkCapacity;
+		ecsResizeChunks(archetype, used);
+		archetype->chunks = ecsShrink(archetype->chunks, &archetype->chunksCapacity, used, sizeof(ECSchunk));
 	}
-	return 1;
 }
@@ -18,14 +18,178 @@ extern "C" {
 #endif
 
 typedef unsigned long long ecsEntityId;
+
+/**
+ * The number of component types that can be registered, a multiple of 64.
+ * Up to 64 an ecsComponentMask is a plain integer that supports the usual bitwise operators,
+ * beyond that it is a struct and masks have to be combined with the ecsMask* functions below,
+ * which work for either width.
+ */
+#ifndef ECS_COMPONENT_BITS
+#define ECS_COMPONENT_BITS 64
+#endif
+#define ECS_MASK_WORDS (ECS_COMPONENT_BITS / 64)
+
+#if ECS_COMPONENT_BITS % 64 != 0 || ECS_COMPONENT_BITS == 0
+#error ECS_COMPONENT_BITS must be a non-zero multiple of 64
+#endif
+
+#if ECS_COMPONENT_BITS == 64
 typedef unsigned long long ecsComponentMask;
+#else
+typedef struct ecsComponentMask {
+	unsigned long long words[ECS_MASK_WORDS];
+} ecsComponentMask;
+#endif
 
 typedef void (*ecsSystemFn)(ecsEntityId*, ecsComponentMask*, size_t, float);
 
+/**
+ * A system receiving a base pointer for each of its component columns.
+ * columns[c] points to the component of entities[0] in column c, the component of entities[i] is at columns[c] + i * strides[c] bytes.
+ * A column is NULL for entities that do not have its component.
+ */
+typedef void (*ecsColumnSystemFn)(ecsEntityId* entities, void** columns, const size_t* strides, size_t count, float deltaTime);
+#define ECS_MAX_SYSTEM_COLUMNS 8
+
+/**
+ * An ecsEntityId holds the index of the entity's slot in its low bits and a version in its high bits.
+ * The version changes every time a slot is reused, so ids of destroyed entities stay invalid.
+ */
+#define ECS_ENTITY_INDEX_BITS		32
+#define ECS_ENTITY_INDEX_MASK		((ecsEntityId)0xFFFFFFFF)
+#define ECS_ENTITY_VERSION_MASK		((ecsEntityId)0xFFFFFFFF)
+#define ecsEntityIndex(__entity)	((size_t)((__entity) & ECS_ENTITY_INDEX_MASK))
+#define ecsEntityVersion(__entity)	(((__entity) >> ECS_ENTITY_INDEX_BITS) & ECS_ENTITY_VERSION_MASK)
+
 #define noentity		((ecsEntityId)0x0)
+
+#if ECS_COMPONENT_BITS == 64
+
 #define nocomponent		((ecsComponentMask)0x0)
 #define anycomponent	((ecsComponentMask)~0x0)
 
+static inline ecsComponentMask ecsMaskOr(ecsComponentMask a, ecsComponentMask b)		{ return a | b; }
+static inline ecsComponentMask ecsMaskAnd(ecsComponentMask a, ecsComponentMask b)		{ return a & b; }
+static inline ecsComponentMask ecsMaskAndNot(ecsComponentMask a, ecsComponentMask b)	{ return a & ~b; }
+static inline int ecsMaskEqual(ecsComponentMask a, ecsComponentMask b)					{ return a == b; }
+static inline int ecsMaskIsEmpty(ecsComponentMask a)									{ return a == 0; }
+static inline int ecsMaskIntersects(ecsComponentMask a, ecsComponentMask b)				{ return (a & b) != 0; }
+static inline int ecsMaskContains(ecsComponentMask a, ecsComponentMask b)				{ return (a & b) == b; }
+static inline ecsComponentMask ecsMaskBit(size_t index)									{ return 0x1ull << index; }
+
+#else
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+static inline ecsComponentMask ecsMaskNone(void)
+{
+	ecsComponentMask r;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) r.words[i] = 0x0;
+	return r;
+}
+
+static inline ecsComponentMask ecsMaskAll(void)
+{
+	ecsComponentMask r;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) r.words[i] = ~0x0ull;
+	return r;
+}
+
+#define nocomponent		ecsMaskNone()
+#define anycomponent	ecsMaskAll()
+
+static inline ecsComponentMask ecsMaskOr(ecsComponentMask a, ecsComponentMask b)
+{
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) a.words[i] |= b.words[i];
+	return a;
+}
+
+static inline ecsComponentMask ecsMaskAnd(ecsComponentMask a, ecsComponentMask b)
+{
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) a.words[i] &= b.words[i];
+	return a;
+}
+
+static inline ecsComponentMask ecsMaskAndNot(ecsComponentMask a, ecsComponentMask b)
+{
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) a.words[i] &= ~b.words[i];
+	return a;
+}
+
+static inline int ecsMaskEqual(ecsComponentMask a, ecsComponentMask b)
+{
+	unsigned long long diff = 0;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) diff |= a.words[i] ^ b.words[i];
+	return diff == 0;
+}
+
+static inline int ecsMaskIsEmpty(ecsComponentMask a)
+{
+	unsigned long long any = 0;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) any |= a.words[i];
+	return any == 0;
+}
+
+/**
+ * \brief Checks whether a and b share any component.
+ */
+static inline int ecsMaskIntersects(ecsComponentMask a, ecsComponentMask b)
+{
+#if defined(__AVX2__) && ECS_MASK_WORDS % 4 == 0
+	__m256i any = _mm256_setzero_si256();
+	for(size_t i = 0; i < ECS_MASK_WORDS; i += 4)
+		any = _mm256_or_si256(any, _mm256_and_si256(
+			_mm256_loadu_si256((const __m256i*)(a.words + i)), _mm256_loadu_si256((const __m256i*)(b.words + i))));
+	return !_mm256_testz_si256(any, any);
+#elif defined(__SSE4_1__) && ECS_MASK_WORDS % 2 == 0
+	__m128i any = _mm_setzero_si128();
+	for(size_t i = 0; i < ECS_MASK_WORDS; i += 2)
+		any = _mm_or_si128(any, _mm_and_si128(
+			_mm_loadu_si128((const __m128i*)(a.words + i)), _mm_loadu_si128((const __m128i*)(b.words + i))));
+	return !_mm_testz_si128(any, any);
+#else
+	unsigned long long any = 0;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) any |= a.words[i] & b.words[i];
+	return any != 0;
+#endif
+}
+
+/**
+ * \brief Checks whether a has every component of b.
+ */
+static inline int ecsMaskContains(ecsComponentMask a, ecsComponentMask b)
+{
+#if defined(__AVX2__) && ECS_MASK_WORDS % 4 == 0
+	__m256i missing = _mm256_setzero_si256();
+	for(size_t i = 0; i < ECS_MASK_WORDS; i += 4)
+		missing = _mm256_or_si256(missing, _mm256_andnot_si256(
+			_mm256_loadu_si256((const __m256i*)(a.words + i)), _mm256_loadu_si256((const __m256i*)(b.words + i))));
+	return _mm256_testz_si256(missing, missing);
+#elif defined(__SSE4_1__) && ECS_MASK_WORDS % 2 == 0
+	__m128i missing = _mm_setzero_si128();
+	for(size_t i = 0; i < ECS_MASK_WORDS; i += 2)
+		missing = _mm_or_si128(missing, _mm_andnot_si128(
+			_mm_loadu_si128((const __m128i*)(a.words + i)), _mm_loadu_si128((const __m128i*)(b.words + i))));
+	return _mm_testz_si128(missing, missing);
+#else
+	unsigned long long missing = 0;
+	for(size_t i = 0; i < ECS_MASK_WORDS; i++) missing |= b.words[i] & ~a.words[i];
+	return missing == 0;
+#endif
+}
+
+static inline ecsComponentMask ecsMaskBit(size_t index)
+{
+	ecsComponentMask r = ecsMaskNone();
+	r.words[index / 64] = 0x1ull << (index % 64);
+	return r;
+}
+
+#endif
+
 typedef enum ECSqueryComparison {
 	ECS_NOQUERY = 0x0,
 	ECS_QUERY_ANY,
@@ -37,14 +201,85 @@ typedef struct ecsComponentQuery {
 	ecsComponentMask mask;
 } ecsComponentQuery;
 
+/**
+ * \brief Compound component requirement, matched by entities with all of all, at least one of any and none of none.
+ * \note An empty any mask is ignored.
+ */
+typedef struct ecsQueryDesc {
+	ecsComponentMask all;
+	ecsComponentMask any;
+	ecsComponentMask none;
+} ecsQueryDesc;
+
+/**
+ * \brief Checks if a component mask matches a compound query.
+ * \returns 1 if mask matches query, 0 otherwise.
+ */
+int ecsMatchQueryDesc(const ecsQueryDesc* query, ecsComponentMask mask);
+
+/**
+ * \brief Functions a world allocates all of its memory with.
+ * \note Worker threads allocate as well, so the functions have to be thread safe unless the world runs on a single thread.
+ */
+typedef struct ecsAllocator {
+	void* (*allocate)(void* user, size_t size);					//! Like malloc, memory has to be aligned for any type.
+	void* (*reallocate)(void* user, void* ptr, size_t size);	//! Like realloc, ptr may be NULL.
+	void (*release)(void* user, void* ptr);						//! Like free, ptr may be NULL.
+	void* user;													//! Passed to every call.
+} ecsAllocator;
+
+/**
+ * \brief Settings for ecsInitEx.
+ */
+typedef struct ecsConfig {
+	int threadCount;	//! Number of threads multithreaded systems run on, including the caller of ecsRunSystems. 0 for one per hardware thread.
+	size_t profileFrames;	//! Number of frames to keep timings of, see ecsGetFrameProfile. 0 disables profiling.
+	const ecsAllocator* allocator;	//! Allocator to use until the world is terminated, NULL for malloc, realloc and free. Copied.
+} ecsConfig;
+
+/**
+ * \brief Initializes the ECS with default settings.
+ */
 void ecsInit(void);
 
+/**
+ * \brief Initializes the ECS.
+ * \param config Settings to use, NULL for defaults.
+ * \returns 0 if out of memory, the ECS is left uninitialized then.
+ * \note Starts the worker threads that run multithreaded systems, they are parked while no systems are running.
+ * If they cannot be started, every system runs on the thread calling ecsRunSystems.
+ */
+int ecsInitEx(const ecsConfig* config);
+
+#define ECS_MAX_COMPONENT_ALIGN 64	//! Largest alignment a component type can ask for, one cache line.
+
 /**
  * \brief Allocates a component list for a component type of stride bytes.
+ * \note Components are packed, only the start of each column is aligned to 16 bytes.
  * \param stride The number of bytes to allocate for each component.
+ * 0 makes a tag, which takes no storage and is only kept in entity masks.
+ * Attaching or detaching a tag does not move the entity.
  */
 ecsComponentMask ecsMakeComponentType(size_t stride);
-#define ecsRegisterComponent(__type) ecsMakeComponentType(sizeof(__type))
+
+/**
+ * \brief Allocates a component list for a component type of stride bytes with at least the given alignment.
+ * \param alignment A power of two up to ECS_MAX_COMPONENT_ALIGN.
+ * Every component and the start of every column passed to column systems is aligned to it,
+ * so columns of vector types can be processed with aligned loads.
+ * \returns The new component type, nocomponent if there is no room for it, alignment is not supported
+ * or stride is not a multiple of alignment.
+ */
+ecsComponentMask ecsMakeAlignedComponentType(size_t stride, size_t alignment);
+
+#if __cplusplus
+#define ecsAlignOf(__type) alignof(__type)
+#else
+#define ecsAlignOf(__type) _Alignof(__type)
+#endif
+
+#define ecsRegisterComponent(__type) ecsMakeAlignedComponentType(sizeof(__type), ecsAlignOf(__type))
+#define ecsRegisterTag() ecsMakeComponentType(0)
 
 /**
  * \brief Get a pointer to a component attached to entity.
@@ -52,9 +287,18 @@ ecsComponentMask ecsMakeComponentType(size_t stride);
  * \param component The component type to find.
  * \returns A pointer to a component if found.
  * \returns NULL if entity does not contain the given component.
+ * \note Marks the component as changed, see ecsSystemDesc.changedComponents.
  */
 void* ecsGetComponentPtr(ecsEntityId entity, ecsComponentMask component);
 
+/**
+ * \brief Get a read only pointer to a component attached to entity, without marking it as changed.
+ * \param entity The entity to find a component of.
+ * \param component The component type to find.
+ * \returns NULL if entity does not contain the given component.
+ */
+const void* ecsReadComponentPtr(ecsEntityId entity, ecsComponentMask component);
+
 /**
  * \brief Assigns a new entity id.
  * \param components  A component query referencing the components to add to the new object.
@@ -63,12 +307,52 @@ void* ecsGetComponentPtr(ecsEntityId entity, ecsComponentMask component);
  */
 ecsEntityId ecsCreateEntity(ecsComponentMask components);
 
+/**
+ * \brief Creates many entities with the same components at once.
+ * \param components The components to add to each new entity.
+ * \param count The number of entities to create.
+ * \param outIds Receives the ids of the new entities, may be NULL.
+ * \returns The number of entities created, less than count if allocation failed.
+ */
+size_t ecsCreateEntities(ecsComponentMask components, size_t count, ecsEntityId* outIds);
+
+/**
+ * \brief Assigns a new entity id and initializes its components from data.
+ * \param components The components to add to the new entity.
+ * \param data One pointer per component in components, in order of component id, to copy the initial value from.
+ * NULL entries are zeroed.
+ * \returns The id of the new entity, noentity if allocation failed.
+ */
+ecsEntityId ecsCreateEntityWithData(ecsComponentMask components, const void* const* data);
+
+/**
+ * \brief Creates many entities with the same components and initializes them from data.
+ * \param components The components to add to each new entity.
+ * \param count The number of entities to create.
+ * \param data One array of count values per component in components, in order of component id.
+ * NULL entries are zeroed.
+ * \param outIds Receives the ids of the new entities, may be NULL.
+ * \returns The number of entities created, less than count if allocation failed.
+ */
+size_t ecsCreateEntitiesWithData(ecsComponentMask components, size_t count, const void* const* data, ecsEntityId* outIds);
+
+/**
+ * \brief Reserves ids for entities that are created when ecsRunTasks runs.
+ * \param components The components to add to each new entity.
+ * \param count The number of entities to create.
+ * \param outIds Receives the ids of the new entities.
+ * \returns count, or 0 if there are no ids left.
+ * \note Systems may call this from any thread. The ids are invalid until ecsRunTasks,
+ * but can be passed to ecsDestroyEntity and ecsDetachComponents right away.
+ */
+size_t ecsCreateEntitiesDeferred(ecsComponentMask components, size_t count, ecsEntityId* outIds);
+
 /**
  * \brief Gets the component mask for an entity.
  * \param entity the entity to get the mask for.
  * \returns the ecsComponentMask for entity.
  */
-ecsEntityId ecsGetComponentMask(ecsEntityId entity);
+ecsComponentMask ecsGetComponentMask(ecsEntityId entity);
 
 /**
  * \brief Checks if the argument is a valid entity id of a currently existing entity.
@@ -80,6 +364,8 @@ int ecsValidEntity(ecsEntityId entity);
 /**
  * \brief Destroys an entity and all associated components
  * \param entity The id of the entity to destroy.
+ * \note Deferred until ecsRunTasks.
+ * Systems may call this from any thread, tasks pushed by systems run in system order and then entity order.
  */
 void ecsDestroyEntity(ecsEntityId entity);
 
@@ -90,10 +376,37 @@ void ecsDestroyEntity(ecsEntityId entity);
  */
 void ecsAttachComponents(ecsEntityId entity, ecsComponentMask components);
 
+/**
+ * \brief Attaches a component and copies its value from data.
+ * \param entity The entity to attach the component to.
+ * \param component The component to attach.
+ * \param data The value of the component, NULL to zero it. Overwrites the component if it already exists.
+ */
+void ecsAttachComponentWithData(ecsEntityId entity, ecsComponentMask component, const void* data);
+
+/**
+ * \brief Attaches one or more components and copies their values from data.
+ * \param entity The entity to attach the new components to.
+ * \param components Bitmask of the componentId's to attach.
+ * \param data One pointer per component in components, in order of component id.
+ * NULL entries zero new components and keep existing ones, others overwrite existing components.
+ */
+void ecsAttachComponentsWithData(ecsEntityId entity, ecsComponentMask components, const void* const* data);
+
+/**
+ * \brief Attaches one or more components to many entities at once.
+ * \param entities The entities to attach the new components to.
+ * \param count The number of ids in entities.
+ * \param components Bitmask of the componentId's to attach.
+ * \note Invalid ids, duplicates and entities that already have the components are skipped.
+ */
+void ecsAttachComponentsBulk(const ecsEntityId* entities, size_t count, ecsComponentMask components);
+
 /**
  * \brief Detaches one or more components.
  * \param entity The entity to detach components from.
  * \param components Bitmask of the components to detach.
+ * \note Deferred until ecsRunTasks like ecsDestroyEntity.
  */
 void ecsDetachComponents(ecsEntityId entity, ecsComponentMask components);
 
@@ -106,21 +419,147 @@ void ecsDetachComponents(ecsEntityId entity, ecsComponentMask components);
  * When comparison=ECS_QUERY_ALL the system will run only when all of the masked components are present on an entity.
  * \note
  * When comparison=ECS_QUERY_ANY the system will run for all entities where any of the masked components are present.
+ * \note
+ * Matching entities are stored in chunks grouped by component mask,
+ * the system may be called several times per frame with one contiguous run of entities each time.
  */
 void ecsEnableSystem(ecsSystemFn func, ecsComponentMask components, ecsQueryComparison comparison, int maxThreads, int executionOrder);
 
+/**
+ * \brief Describes a system for ecsEnableSystemEx.
+ * \note Members left zero behave like the matching ecsEnableSystem argument set to zero.
+ */
+typedef struct ecsSystemDesc {
+	ecsSystemFn			fn;				//! The function to call when query is met.
+	ecsComponentMask	components;		//! The required components to run this system.
+	ecsQueryComparison	comparison;		//! The type of requirement components represent.
+	int					maxThreads;		//! The maximum number of threads working on matching entities at once.
+	int					executionOrder;	//! Systems run in ascending execution order.
+	size_t				grainSize;		//! The number of entities below which work is no longer split between threads, 0 to pick automatically.
+	ecsComponentMask	readComponents;	//! Components the system only reads.
+	ecsComponentMask	writeComponents;//! Components the system writes.
+	ecsColumnSystemFn	columnFn;		//! Called instead of fn when set.
+	ecsComponentMask	columns[ECS_MAX_SYSTEM_COLUMNS];	//! Single components passed to columnFn in this order, up to the first empty mask.
+	ecsComponentMask	anyComponents;	//! Entities also need at least one of these, ignored when empty unless comparison is ECS_QUERY_ANY.
+	ecsComponentMask	noneComponents;	//! Entities having any of these are skipped.
+	ecsComponentMask	changedComponents;	//! Only entities where one of these changed since the system last ran, if not empty.
+	const char*			name;			//! Shown in profiles, may be NULL. Has to stay valid while the system is enabled.
+} ecsSystemDesc;
+
+/**
+ * \brief Enables a function to act as a system, with all options available.
+ * \param desc Description of the system, copied before returning.
+ * \note
+ * Multithreaded systems are split into ranges of at least grainSize entities which idle threads steal from busy ones,
+ * a small grain size balances uneven per-entity cost better at the price of more calls.
+ * \note
+ * Systems that declare the components they read or write run concurrently with systems they do not conflict with,
+ * on any thread. execOrder is only honoured between systems where one writes components the other reads or writes.
+ * Such systems should only change entities through deferred calls like ecsDestroyEntity and ecsDetachComponents.
+ * \note
+ * Systems that declare neither start on the thread calling ecsRunSystems, after every system before them and before every system after them.
+ * Ranges split off them when maxThreads is above 1 may still run on any thread.
+ * \note
+ * Column systems are called once per contiguous run of entities with a pointer to the first component of each column,
+ * letting them index components directly instead of calling ecsGetComponentPtr per entity.
+ * \note
+ * Changes are tracked per chunk, a system with changedComponents also sees unchanged entities sharing a chunk with changed ones.
+ * Components count as changed when they are added, written through ecsGetComponentPtr,
+ * or passed to a system that declares them in writeComponents. Tags are not tracked.
+ */
+void ecsEnableSystemEx(const ecsSystemDesc* desc);
+
 /**
  * \brief Disables a function acting as a system.
  * \param func Pointer to the function to disable.
  */
 void ecsDisableSystem(ecsSystemFn func);
 
+/**
+ * \brief Disables a system enabled with ecsSystemDesc.columnFn.
+ * \param func Pointer to the function to disable.
+ */
+void ecsDisableColumnSystem(ecsColumnSystemFn func);
+
 /**
  * \brief Run currently enabled systems.
  * \note Implicitly calls ecsRunTasks after completion.
  */
 void ecsRunSystems(float deltaTime);
 
+/**
+ * \brief Timings of a system during one frame.
+ * \note All times are in nanoseconds.
+ */
+typedef struct ecsSystemProfile {
+	const char*			name;			//! ecsSystemDesc.name of the system.
+	ecsSystemFn			fn;
+	ecsColumnSystemFn	columnFn;
+	unsigned long long	startTime;		//! Time from the start of the frame until the system started.
+	unsigned long long	wallTime;		//! Time from the start of the system until its last range finished.
+	unsigned long long	gatherTime;		//! Time spent collecting matching chunks before running.
+	unsigned long long	rangeTime;		//! Time spent in the system summed over all threads.
+	size_t				rangeCount;		//! Number of ranges the entities were split into.
+	size_t				entityCount;	//! Number of matching entities.
+} ecsSystemProfile;
+
+/**
+ * \brief Time a thread spent running systems during one frame, in nanoseconds.
+ */
+typedef struct ecsThreadProfile {
+	unsigned long long	busyTime;
+	size_t				rangeCount;
+} ecsThreadProfile;
+
+/**
+ * \brief Timings of one call to ecsRunSystems.
+ */
+typedef struct ecsFrameProfile {
+	size_t				frame;			//! Number of frames profiled before this one.
+	unsigned long long	wallTime;		//! Time spent in ecsRunSystems, in nanoseconds.
+	unsigned long long	taskTime;		//! Time spent in ecsRunTasks since the previous frame, in nanoseconds.
+	size_t				taskCount;		//! Number of tasks run since the previous frame.
+	size_t				systemCount;
+	ecsSystemProfile*	systems;		//! Systems that ran, in execution order.
+	size_t				threadCount;
+	ecsThreadProfile*	threads;		//! Index 0 is the thread calling ecsRunSystems.
+} ecsFrameProfile;
+
+/**
+ * \brief Gets the number of frames ecsGetFrameProfile can return.
+ * \returns At most ecsConfig.profileFrames, 0 if profiling is off.
+ */
+size_t ecsGetProfiledFrameCount(void);
+
+/**
+ * \brief Gets the timings of a recent frame.
+ * \param age 0 for the latest frame, 1 for the one before and so on.
+ * \returns NULL if the frame is no longer kept or profiling is off.
+ * \note The profile is overwritten once ecsConfig.profileFrames more frames ran.
+ */
+const ecsFrameProfile* ecsGetFrameProfile(size_t age);
+
+/**
+ * \brief Starts recording a timeline of system runs, thread ranges, task flushes and structural changes.
+ * \param eventsPerThread The number of events each thread can record, later events are dropped.
+ * \returns 1 on success, 0 if out of memory.
+ * \note Discards events of a previous trace. Call between frames.
+ */
+int ecsStartTrace(size_t eventsPerThread);
+
+/**
+ * \brief Stops recording and discards the recorded events.
+ */
+void ecsStopTrace(void);
+
+/**
+ * \brief Writes the events recorded so far to a file in the Chrome trace event format.
+ * \param path The file to write, open it with chrome://tracing or ui.perfetto.dev.
+ * \returns 1 on success, 0 if not tracing or the file could not be written.
+ * \note Systems appear on a track each, next to the tracks of the threads that ran their ranges. Call between frames.
+ */
+int ecsWriteTrace(const char* path);
+
 /**
  * \brief Run queued tasks.
  */
@@ -131,6 +570,48 @@ void ecsRunTasks(void);
  */
 void ecsTerminate(void);
 
+/**
+ * \brief An independent instance of the ECS with its own entities, components, systems and worker threads.
+ * \note Every other function acts on the calling thread's current world, see ecsSetCurrentWorld.
+ * ecsInit and ecsTerminate set up and tear down the current world, which is the default world unless changed.
+ */
+typedef struct ecsWorld ecsWorld;
+
+/**
+ * \brief Creates and initializes a world, does not change the current world.
+ * \param config Settings to use, NULL for defaults.
+ * \returns The new world, NULL if out of memory.
+ */
+ecsWorld* ecsCreateWorld(const ecsConfig* config);
+
+/**
+ * \brief Terminates a world created by ecsCreateWorld and frees it.
+ * \note The world must not be current on any thread.
+ */
+void ecsDestroyWorld(ecsWorld* world);
+
+/**
+ * \brief Makes the calling thread act on a world.
+ * \param world World to act on, NULL for the default world.
+ * \returns The previously current world.
+ * \note Worlds share no state, so different threads may run different worlds concurrently.
+ * Must not be called from inside a system.
+ */
+ecsWorld* ecsSetCurrentWorld(ecsWorld* world);
+
+/**
+ * \brief The world the calling thread acts on.
+ */
+ecsWorld* ecsGetCurrentWorld(void);
+
+/**
+ * \brief Releases memory that is reserved but not in use.
+ * \note Internal lists grow geometrically and keep their capacity so that steady state frames do not allocate,
+ * call this after a burst of entity creation to return the excess.
+ * \note Must not be called while systems are running.
+ */
+void ecsShrinkToFit(void);
+
 #if __cplusplus
 }
 #endif